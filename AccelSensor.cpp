@@ -35,27 +35,60 @@
 
 /*****************************************************************************/
 
-sensors_vec_t  AccelSensor::dataBuffer;
-int AccelSensor::mEnabled = 0;
-int64_t AccelSensor::delayms = 0;
-int AccelSensor::current_fullscale = 0;
-int64_t AccelSensor::setDelayBuffer[numSensors] = {0};
-int64_t AccelSensor::writeDelayBuffer[numSensors] = {0};
-int AccelSensor::DecimationBuffer[numSensors] = {0};
-int AccelSensor::DecimationCount = 0;
-pthread_mutex_t AccelSensor::dataMutex;
-
-AccelSensor::AccelSensor()
-	: SensorBase(NULL, SENSOR_DATANAME_ACCELEROMETER),
+AccelSensor* AccelSensor::single = NULL;
+
+/*
+ * Every logical sensor built on the accelerometer shares the same
+ * instance, so the input device is opened and decoded only once.
+ * Extra IMUs of the same model are plain instances owned by the poll
+ * context, each reporting under its own handle.
+ */
+AccelSensor* AccelSensor::getInstance()
+{
+	if (!single)
+		single = new AccelSensor();
+	else
+		single->get();
+
+	return single;
+}
+
+AccelSensor::AccelSensor(int instance, int32_t handle)
+#if (ACCEL_IIO_ENABLE == 1)
+	: SensorBase(NULL, NULL),
+	mInstance(instance),
+	mHandle(handle),
+	mInputReader(6),
+	mHasPendingEvent(false),
+	mIIOReader(ACCEL_IIO_CHANNEL)
+#else
+	: SensorBase(NULL, SENSOR_DATANAME_ACCELEROMETER, instance),
+	mInstance(instance),
+	mHandle(handle),
 	mInputReader(6),
 	mHasPendingEvent(false)
+#endif
 {
-	pthread_mutex_init(&dataMutex, NULL);
+	mEnabled = 0;
+	delayms = 0;
+	current_fullscale = 0;
+	memset(setDelayBuffer, 0, sizeof(setDelayBuffer));
+	memset(writeDelayBuffer, 0, sizeof(writeDelayBuffer));
+
+	mTransformValid = false;
+
+#if (ACCEL_IIO_ENABLE == 1)
+	data_fd = openIIO(SENSOR_IIO_ACCELEROMETER, instance);
+	if ((data_fd >= 0) && (mIIOReader.setup(sysfs_device_path) < 0)) {
+		close(data_fd);
+		data_fd = -1;
+	}
+#endif
 
 	memset(mPendingEvents, 0, sizeof(mPendingEvents));
 
 	mPendingEvents[Acceleration].version = sizeof(sensors_event_t);
-	mPendingEvents[Acceleration].sensor = ID_ACCELEROMETER;
+	mPendingEvents[Acceleration].sensor = handle;
 	mPendingEvents[Acceleration].type = SENSOR_TYPE_ACCELEROMETER;
 	mPendingEvents[Acceleration].acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
 
@@ -75,6 +108,7 @@ AccelSensor::AccelSensor()
 
 #if defined(STORE_CALIB_ACCEL_ENABLED)
 	pStoreCalibration = StoreCalibration::getInstance();
+	mCalibSerial = 0;
 #endif
 
 	if (data_fd) {
@@ -89,9 +123,10 @@ AccelSensor::AccelSensor()
 AccelSensor::~AccelSensor()
 {
 	if (mEnabled) {
-		enable(SENSORS_ACCELEROMETER_HANDLE, 0, 0);
+		enable(mHandle, 0, 0);
 	}
-	pthread_mutex_destroy(&dataMutex);
+	if (single == this)
+		single = NULL;
 }
 
 #if !defined(NOT_SET_ACC_INITIAL_STATE)
@@ -109,7 +144,6 @@ int AccelSensor::setInitialState()
 	}
 
 	setFullScale(SENSORS_ACCELEROMETER_HANDLE, ACCEL_DEFAULT_FULLSCALE);
-	DecimationCount = 0;
 
 	return 0;
 }
@@ -119,10 +153,10 @@ int AccelSensor::getWhatFromHandle(int32_t handle)
 {
 	int what = -1;
 
+	if (handle == mHandle)
+		return Acceleration;
+
 	switch(handle) {
-		case SENSORS_ACCELEROMETER_HANDLE:
-			what = Acceleration;
-			break;
 #if (SENSORS_SIGNIFICANT_MOTION_ENABLE == 1)
 		case SENSORS_SIGNIFICANT_MOTION_HANDLE:
 			what = SignificantMotion;
@@ -311,6 +345,15 @@ int AccelSensor::setDelay(int32_t handle, int64_t delay_ns)
 	return err;
 }
 
+int AccelSensor::setLatency(int64_t latency_ns)
+{
+	SensorBase::setLatency(latency_ns);
+	mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+				MSEC_TO_NSEC(delayms), report_latency));
+
+	return 0;
+}
+
 int AccelSensor::writeMinDelay(void)
 {
 	int err = 0;
@@ -349,20 +392,20 @@ int AccelSensor::writeMinDelay(void)
 		if(err >= 0) {
 			err = 0;
 			delayms = Min_delay_ms;
-			DecimationCount = 0;
+			mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+					MSEC_TO_NSEC(delayms), report_latency));
+			mTimestampEstimator.setPeriod(MSEC_TO_NSEC(delayms));
 		}
 	}
 
 	// Decimation Definition
 	for(kk = 0; kk < numSensors; kk++)
 	{
-		if (kk == Acceleration || kk == Gbias)
+		if (kk == Gbias)
 			continue;
 
-		if (delayms)
-			DecimationBuffer[kk] = writeDelayBuffer[kk]/delayms;
-		else
-			DecimationBuffer[kk] = 0;
+		Decimation[kk].setPeriod(delayms ?
+				MSEC_TO_NSEC(writeDelayBuffer[kk]) : 0);
 	}
 
 #if (DEBUG_POLL_RATE == 1)
@@ -375,13 +418,13 @@ int AccelSensor::writeMinDelay(void)
 						writeDelayBuffer[10]);
 	STLOGD("AccSensor::Min_delay_ms = %lld, delayms = %lld, mEnabled = %d",
 						Min_delay_ms, delayms, mEnabled);
-	STLOGD("AccSensor::DecimationBuffer = %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d",
-						DecimationBuffer[0], DecimationBuffer[1],
-						DecimationBuffer[2], DecimationBuffer[3],
-						DecimationBuffer[4], DecimationBuffer[5],
-						DecimationBuffer[6], DecimationBuffer[7],
-						DecimationBuffer[8], DecimationBuffer[9],
-						DecimationBuffer[10]);
+	STLOGD("AccSensor::Decimation periods = %lld, %lld, %lld, %lld, %lld, %lld, %lld, %lld, %lld, %lld, %lld",
+						Decimation[0].getPeriod(), Decimation[1].getPeriod(),
+						Decimation[2].getPeriod(), Decimation[3].getPeriod(),
+						Decimation[4].getPeriod(), Decimation[5].getPeriod(),
+						Decimation[6].getPeriod(), Decimation[7].getPeriod(),
+						Decimation[8].getPeriod(), Decimation[9].getPeriod(),
+						Decimation[10].getPeriod());
 #endif
 
 	return err;
@@ -415,6 +458,149 @@ int AccelSensor::setFullScale(int32_t  __attribute__((unused))handle, int value)
 	return err;
 }
 
+/*
+ * Fold conversion factor, axis matrix and calibration into mTransform,
+ * only when the calibration changed since the last block.
+ */
+void AccelSensor::updateTransform()
+{
+#if (ACCEL_IIO_ENABLE == 1)
+	const float iio_scale = mIIOReader.getScale();
+	const float scale[3] = { iio_scale, iio_scale, iio_scale };
+#else
+	static const float scale[3] = { CONVERT_A_X, CONVERT_A_Y, CONVERT_A_Z };
+#endif
+#if defined(STORE_CALIB_ACCEL_ENABLED)
+	float bias[3] = { 0.0f, 0.0f, 0.0f };
+	float sens[3] = { 1.0f, 1.0f, 1.0f };
+
+	/* The stored calibration belongs to the primary chip only */
+	if (mInstance == 0) {
+		if (!pStoreCalibration->isChanged(&mCalibSerial) && mTransformValid)
+			return;
+
+		for (int i = 0; i < 3; i++) {
+			bias[i] = pStoreCalibration->getCalibration(
+					StoreCalibration::ACCELEROMETER_BIAS,
+					StoreCalibration::XAxis + i);
+			sens[i] = pStoreCalibration->getCalibration(
+					StoreCalibration::ACCELEROMETER_SENS,
+					StoreCalibration::XAxis + i);
+		}
+	} else if (mTransformValid)
+		return;
+#else
+	static const float bias[3] = { 0.0f, 0.0f, 0.0f };
+	static const float sens[3] = { 1.0f, 1.0f, 1.0f };
+
+	if (mTransformValid)
+		return;
+#endif
+
+	mTransform.set(scale, matrix_acc, bias, sens);
+	mTransformValid = true;
+}
+
+/*
+ * Run scale, axis remap and calibration over the decoded frames at once,
+ * then dispatch them one by one, at most count events being returned.
+ */
+int AccelSensor::processSamples(sensors_event_t* data, int count)
+{
+	int numEventReceived = 0;
+	int i;
+
+	updateTransform();
+	mSamples.transform(mTransform);
+
+	for (i = mSamples.first; count && (i < mSamples.count); i++) {
+		data_rot[0] = mSamples.x[i];
+		data_rot[1] = mSamples.y[i];
+		data_rot[2] = mSamples.z[i];
+		timestamp = mSamples.timestamp[i];
+
+		if ((mEnabled & (1<<Acceleration)) &&
+		   Decimation[Acceleration].sample(timestamp, data_rot,
+					mPendingEvents[Acceleration].data)) {
+			mPendingEvents[Acceleration].timestamp = timestamp;
+			mPendingMask |= 1<<Acceleration;
+		}
+
+#if (SENSORS_ACTIVITY_RECOGNIZER_ENABLE == 1)
+		if (mEnabled & (1<<ActivityReco))
+		{
+			int activity_changed = 0;
+
+			mPendingEvents[ActivityReco].data[0] =
+					(float)ActivityRecognizerFunction(
+						-MS2_TO_G(data_rot[0]),
+						-MS2_TO_G(data_rot[1]),
+						-MS2_TO_G(data_rot[2]),
+						&activity_changed);
+			if (activity_changed != 0) {
+#if (DEBUG_ACTIVITY_RECO == 1)
+				ALOGD("ActivityRecognizerSensor::readEvents, activity = %d",
+				      mPendingEvents[ActivityReco].data[0]);
+#endif
+
+				mPendingEvents[ActivityReco].timestamp = timestamp;
+				mPendingMask |= 1<<ActivityReco;
+			}
+		}
+#endif
+
+		if (mEnabled & ((1<<iNemoAcceleration) | (1<<MagCalAcceleration) |
+			(1<<GeoMagRotVectAcceleration) | (1<<Orientation) |
+			(1<<Linear_Accel) | (1<<Gravity_Accel) | (1<<Gbias) |
+			(1<<VirtualGyro)))
+		{
+			sensors_vec_t sData;
+			memcpy(sData.v, data_rot, sizeof(data_rot));
+			setBufferData(&sData, timestamp);
+		}
+
+#if (DEBUG_ACCELEROMETER == 1)
+		STLOGD("AccelSensor(Acceleration)::readEvents (time = %lld), count(%d), received(%d)",
+					mPendingEvents[Acceleration].timestamp,
+					count, numEventReceived);
+#endif
+
+		int n = flushPendingEvents(data, count);
+		data += n;
+		count -= n;
+		numEventReceived += n;
+	}
+
+	mSamples.consume(i - mSamples.first);
+
+	/* Wake the drivers clocked by this one (fusion, virtual gyroscope) */
+	dataBuffer.notify();
+
+	return numEventReceived;
+}
+
+int AccelSensor::flushPendingEvents(sensors_event_t* data, int count)
+{
+	int numEventReceived = 0;
+
+	for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
+		if (mPendingMask & (1<<j)) {
+			mPendingMask &= ~(1<<j);
+#if (SENSORS_SIGNIFICANT_MOTION_ENABLE == 1)
+			if((j == SignificantMotion) && mPendingEvents[j].data[0] == 0.0f)
+				enable(SENSORS_SIGNIFICANT_MOTION_HANDLE, 0, 0);
+#endif
+			if (mEnabled & (1<<j)) {
+				*data++ = mPendingEvents[j];
+				count--;
+				numEventReceived++;
+			}
+		}
+	}
+
+	return numEventReceived;
+}
+
 int AccelSensor::readEvents(sensors_event_t* data, int count)
 {
 	if (count < 1)
@@ -424,6 +610,14 @@ int AccelSensor::readEvents(sensors_event_t* data, int count)
 		mHasPendingEvent = false;
 	}
 
+#if (ACCEL_IIO_ENABLE == 1)
+	/* Scans are decoded straight into mSamples, timestamps included */
+	ssize_t n = mIIOReader.fill(data_fd, &mSamples, count - mSamples.pending());
+	if (n < 0)
+		return n;
+
+	return processSamples(data, count);
+#else
 	ssize_t n = mInputReader.fill(data_fd);
 	if (n < 0)
 		return n;
@@ -434,20 +628,44 @@ int AccelSensor::readEvents(sensors_event_t* data, int count)
 #if (FETCH_FULL_EVENT_BEFORE_RETURN)
 	again:
 #endif
-	while (count && mInputReader.readEvent(&event)) {
+	while (count) {
+		bool more = mInputReader.readEvent(&event);
+
+		/*
+		 * Frames are decoded into mSamples and processed as a block when
+		 * it is full, when the input is drained or before any other event.
+		 */
+		if (mSamples.pending() && (!more || mSamples.isFull() ||
+					(mSamples.pending() >= count) ||
+					((event->type != EVENT_TYPE_ACCEL) && (event->type != EV_SYN))
+#if (SENSORS_SIGNIFICANT_MOTION_ENABLE == 1)
+					|| ((event->type == EVENT_TYPE_ACCEL) &&
+					    (event->code == EVENT_TYPE_SIGNIFICANT_MOTION))
+#endif
+					)) {
+			int nb = processSamples(data, count);
+			data += nb;
+			count -= nb;
+			numEventReceived += nb;
+			continue;
+		}
+
+		if (!more)
+			break;
+
 		if (event->type == EVENT_TYPE_ACCEL) {
 #if (DEBUG_ACCELEROMETER == 1)
 	STLOGD("AccelSensor::readEvents (event_code=%d)", event->code);
 #endif
 			float value = (float) event->value;
 			if (event->code == EVENT_TYPE_ACCEL_X) {
-				data_raw[0] = value * CONVERT_A_X;
+				data_raw[0] = value;
 			}
 			else if (event->code == EVENT_TYPE_ACCEL_Y) {
-				data_raw[1] = value * CONVERT_A_Y;
+				data_raw[1] = value;
 			}
 			else if (event->code == EVENT_TYPE_ACCEL_Z) {
-				data_raw[2] = value * CONVERT_A_Z;
+				data_raw[2] = value;
 			}
 #if defined(ACC_EVENT_HAS_TIMESTAMP)
 			else if (event->code == EVENT_TYPE_TIME_MSB) {
@@ -475,107 +693,19 @@ int AccelSensor::readEvents(sensors_event_t* data, int count)
 				STLOGE("AccelSensor: unknown event code (type = %d, code = %d)",
 							event->type, event->code);
 		} else if (event->type == EV_SYN) {
-			data_rot[0] = data_raw[0]*matrix_acc[0][0] +
-					data_raw[1]*matrix_acc[1][0] +
-					data_raw[2]*matrix_acc[2][0];
-			data_rot[1] = data_raw[0]*matrix_acc[0][1] +
-					data_raw[1]*matrix_acc[1][1] +
-					data_raw[2]*matrix_acc[2][1];
-			data_rot[2] = data_raw[0]*matrix_acc[0][2] +
-					data_raw[1]*matrix_acc[1][2] +
-					data_raw[2]*matrix_acc[2][2];
-#if defined(STORE_CALIB_ACCEL_ENABLED)
-			data_rot[0] -= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_BIAS,
-					StoreCalibration::XAxis);
-			data_rot[1] -= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_BIAS,
-					StoreCalibration::YAxis);
-			data_rot[2] -= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_BIAS,
-					StoreCalibration::ZAxis);
-			data_rot[0] *= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_SENS,
-					StoreCalibration::XAxis);
-			data_rot[1] *= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_SENS,
-					StoreCalibration::YAxis);
-			data_rot[2] *= pStoreCalibration->getCalibration(
-					StoreCalibration::ACCELEROMETER_SENS,
-					StoreCalibration::ZAxis);
-#endif
 #if !defined(ACC_EVENT_HAS_TIMESTAMP)
-			timestamp = timevalToNano(event->time);
-
-#endif
-
-			DecimationCount++;
-
-			if ((mEnabled & (1<<Acceleration)) &&
-			   (DecimationCount >= DecimationBuffer[Acceleration])) {
-				DecimationCount = 0;
-
-				memcpy(mPendingEvents[Acceleration].data, data_rot, sizeof(float) * 3);
-				mPendingEvents[Acceleration].timestamp = timestamp;
-				mPendingMask |= 1<<Acceleration;
-			}
-
-#if (SENSORS_ACTIVITY_RECOGNIZER_ENABLE == 1)
-			if (mEnabled & (1<<ActivityReco))
-			{
-				int activity_changed = 0;
-
-				mPendingEvents[ActivityReco].data[0] =
-						(float)ActivityRecognizerFunction(
-							-MS2_TO_G(data_rot[0]),
-							-MS2_TO_G(data_rot[1]),
-							-MS2_TO_G(data_rot[2]),
-							&activity_changed);
-				if (activity_changed != 0) {
-#if (DEBUG_ACTIVITY_RECO == 1)
-					ALOGD("ActivityRecognizerSensor::readEvents, activity = %d",
-					      mPendingEvents[ActivityReco].data[0]);
-#endif
-
-					mPendingEvents[ActivityReco].timestamp = timestamp;
-					mPendingMask |= 1<<ActivityReco;
-				}
-			}
-#endif
-
-			if (mEnabled & ((1<<iNemoAcceleration) | (1<<MagCalAcceleration) |
-				(1<<GeoMagRotVectAcceleration) | (1<<Orientation) |
-				(1<<Linear_Accel) | (1<<Gravity_Accel) | (1<<Gbias) |
-				(1<<VirtualGyro)))
-			{
-				sensors_vec_t sData;
-				memcpy(sData.v, data_rot, sizeof(data_rot));
-				setBufferData(&sData);
-			}
-
-#if (DEBUG_ACCELEROMETER == 1)
-			STLOGD("AccelSensor(Acceleration)::readEvents (time = %lld), count(%d), received(%d)",
-						mPendingEvents[Acceleration].timestamp,
-						count, numEventReceived);
+			timestamp = mTimestampEstimator.estimate(timevalToNano(event->time));
 #endif
+			mSamples.push(data_raw, timestamp);
 		} else {
 			STLOGE("AccelSensor: unknown event type (type = %d, code = %d)", event->type, event->code);
 		}
 
-		for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
-			if (mPendingMask & (1<<j)) {
-				mPendingMask &= ~(1<<j);
-#if (SENSORS_SIGNIFICANT_MOTION_ENABLE == 1)
-				if((j == SignificantMotion) && mPendingEvents[j].data[0] == 0.0f)
-					enable(SENSORS_SIGNIFICANT_MOTION_HANDLE, 0, 0);
-#endif
-				if (mEnabled & (1<<j)) {
-					*data++ = mPendingEvents[j];
-					count--;
-					numEventReceived++;
-				}
-			}
-		}
+		int nb = flushPendingEvents(data, count);
+		data += nb;
+		count -= nb;
+		numEventReceived += nb;
+
 		mInputReader.next();
 	}
 
@@ -590,28 +720,17 @@ int AccelSensor::readEvents(sensors_event_t* data, int count)
 #endif
 
 	return numEventReceived;
+#endif
 }
 
-bool AccelSensor::setBufferData(sensors_vec_t *value)
+SensorHistory* AccelSensor::getHistory()
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(&dataBuffer, value, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
-
-	return true;
+	return &dataBuffer;
 }
 
-bool AccelSensor::getBufferData(sensors_vec_t *lastBufferedValues)
+bool AccelSensor::setBufferData(sensors_vec_t *value, int64_t timestamp)
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(lastBufferedValues, &dataBuffer, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
-
-#if (DEBUG_ACCELEROMETER == 1)
-	STLOGD("AccelSensor: getBufferData got values: x:(%f),y:(%f), z:(%f).",
-					lastBufferedValues->x, lastBufferedValues->y,
-					lastBufferedValues->z);
-#endif
+	dataBuffer.write(value, timestamp);
 
 	return true;
 }
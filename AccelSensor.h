@@ -29,7 +29,14 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "Decimator.h"
+#include "SensorHistory.h"
 #include "InputEventReader.h"
+#include "SampleBlock.h"
+#include "TimestampEstimator.h"
+#if (ACCEL_IIO_ENABLE == 1)
+#include "IIOBufferReader.h"
+#endif
 
 #if defined(STORE_CALIB_ACCEL_ENABLED)
 #include "StoreCalibration.h"
@@ -61,9 +68,11 @@ class AccelSensor : public SensorBase {
 		ActivityReco,
 		numSensors
 	};
-	static int mEnabled;
-	static int64_t delayms;
-	static int current_fullscale;
+	int mInstance;
+	int32_t mHandle;
+	int mEnabled;
+	int64_t delayms;
+	int current_fullscale;
 	InputEventCircularReader mInputReader;
 	uint32_t mPendingMask;
 	sensors_event_t mPendingEvents[numSensors];
@@ -71,31 +80,45 @@ class AccelSensor : public SensorBase {
 	int setInitialState();
 
 private:
-	static sensors_vec_t  dataBuffer;
-	static int64_t setDelayBuffer[numSensors];
-	static int64_t writeDelayBuffer[numSensors];
-	static int DecimationBuffer[numSensors];
-	static int DecimationCount;
-	virtual bool setBufferData(sensors_vec_t *value);
+	SensorHistory dataBuffer;
+	int64_t setDelayBuffer[numSensors];
+	int64_t writeDelayBuffer[numSensors];
+	Decimator Decimation[numSensors];
+	virtual bool setBufferData(sensors_vec_t *value, int64_t timestamp);
 	float data_raw[3];
 	float data_rot[3];
-	static pthread_mutex_t dataMutex;
+	SampleBlock mSamples;
+	SampleTransform mTransform;
+	bool mTransformValid;
+	TimestampEstimator mTimestampEstimator;
+#if (ACCEL_IIO_ENABLE == 1)
+	IIOBufferReader mIIOReader;
+#endif
 	int64_t timestamp;
 #if defined(STORE_CALIB_ACCEL_ENABLED)
 	StoreCalibration *pStoreCalibration;
+	unsigned int mCalibSerial;
 #endif
 
+	static AccelSensor* single;
+
+	void updateTransform();
+	int processSamples(sensors_event_t* data, int count);
+	int flushPendingEvents(sensors_event_t* data, int count);
+
 public:
-	AccelSensor();
+	static AccelSensor* getInstance();
+	AccelSensor(int instance = 0, int32_t handle = SENSORS_ACCELEROMETER_HANDLE);
 	virtual ~AccelSensor();
 	virtual int readEvents(sensors_event_t *data, int count);
 	virtual bool hasPendingEvents() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
+	virtual int setLatency(int64_t latency_ns);
 	virtual int writeMinDelay(void);
-	static void getAccDelay(int64_t *Acc_Delay_ms);
+	void getAccDelay(int64_t *Acc_Delay_ms);
 	virtual int setFullScale(int32_t handle, int value);
 	virtual int enable(int32_t handle, int enabled, int type);
-	static bool getBufferData(sensors_vec_t *lastBufferedValues);
+	SensorHistory* getHistory();
 	virtual int getWhatFromHandle(int32_t handle);
 };
 
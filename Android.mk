@@ -45,7 +45,7 @@ endef
 
 define all-cpp-source-files
        $(patsubst ./%,%, \
-               $(shell cd $(LOCAL_PATH); find . -name "*.cpp"))
+               $(shell cd $(LOCAL_PATH); find . -name "*.cpp" -not -path "./tests/*"))
 endef
 
 ################################################################################
@@ -90,6 +90,11 @@ endef
 # - GBIAS                                                                      #
 # - ACT_RECO                                                                   #
 # - FILE_CALIB                                                                 #
+# - READER_THREADS                                                             #
+# - DECIM_FILTER                                                               #
+# - FUSION_THREAD                                                              #
+# - OPEN_FUSION                                                                #
+# - ROT_PREDICTION                                                             #
 #                                                                              #
 # E.g.: to enable LSM6DS0 + LIS3MDL sensor                                     #
 #                ENABLED_SENSORS := LSM6DS0 LIS3MDL                            #
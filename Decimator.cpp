@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Decimator.h"
+
+/*****************************************************************************/
+
+Decimator::Decimator()
+	: mPeriod(0),
+	mNext(0),
+	mLast(0),
+	mStarted(false)
+{
+#if (SENSORS_DECIMATION_FILTER_ENABLE == 1)
+	mSum[0] = mSum[1] = mSum[2] = 0.0f;
+	mCount = 0;
+#endif
+}
+
+/*
+ * The phase is kept as long as the period does not change.
+ */
+void Decimator::setPeriod(int64_t period_ns)
+{
+	if (period_ns == mPeriod)
+		return;
+
+	mPeriod = period_ns;
+	mStarted = false;
+#if (SENSORS_DECIMATION_FILTER_ENABLE == 1)
+	mSum[0] = mSum[1] = mSum[2] = 0.0f;
+	mCount = 0;
+#endif
+}
+
+/*
+ * Return true if the sample at timestamp has to be delivered. A quarter
+ * of the input period is allowed as timestamp jitter; it never changes
+ * the average rate since the due time moves by the full period.
+ */
+bool Decimator::sample(int64_t timestamp)
+{
+	int64_t dt = timestamp - mLast;
+
+	mLast = timestamp;
+	if (mPeriod <= 0)
+		return true;
+
+	if (!mStarted) {
+		mStarted = true;
+		mNext = timestamp + mPeriod;
+		return true;
+	}
+
+	if (dt < 0)
+		dt = 0;
+
+	if (timestamp + (dt >> 2) < mNext)
+		return false;
+
+	mNext += mPeriod;
+
+	/* Restart the phase after a gap in the stream */
+	if (mNext <= timestamp)
+		mNext = timestamp + mPeriod;
+
+	return true;
+}
+
+/*
+ * Same as above, out is written only for delivered samples: with the
+ * decimation filter it gets the average of in over the window.
+ */
+bool Decimator::sample(int64_t timestamp, const float in[3], float out[3])
+{
+#if (SENSORS_DECIMATION_FILTER_ENABLE == 1)
+	mSum[0] += in[0];
+	mSum[1] += in[1];
+	mSum[2] += in[2];
+	mCount++;
+
+	if (!sample(timestamp))
+		return false;
+
+	const float k = 1.0f / mCount;
+
+	out[0] = mSum[0] * k;
+	out[1] = mSum[1] * k;
+	out[2] = mSum[2] * k;
+
+	mSum[0] = mSum[1] = mSum[2] = 0.0f;
+	mCount = 0;
+#else
+	if (!sample(timestamp))
+		return false;
+
+	out[0] = in[0];
+	out[1] = in[1];
+	out[2] = in[2];
+#endif
+
+	return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_DECIMATOR_H
+#define ANDROID_DECIMATOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "configuration.h"
+
+/*****************************************************************************/
+
+/**
+ * Pick the samples delivered to one client out of the device stream.
+ * The next due time advances by the requested period at each delivered
+ * sample (phase accumulator), so that a client asking for 15 ms on a
+ * 10 ms stream gets two samples out of three and the delivered rate
+ * matches the request instead of the integer ratio of the periods.
+ *
+ * With SENSORS_DECIMATION_FILTER_ENABLE the samples of the window are
+ * averaged (first order CIC, integrate and dump) instead of dropped,
+ * as anti-aliasing filter ahead of the rate reduction.
+ */
+class Decimator {
+	int64_t mPeriod;	/* requested period [ns], 0: every sample */
+	int64_t mNext;		/* timestamp of the next delivered sample */
+	int64_t mLast;		/* timestamp of the last input sample */
+	bool mStarted;
+#if (SENSORS_DECIMATION_FILTER_ENABLE == 1)
+	float mSum[3];
+	int mCount;
+#endif
+
+public:
+	Decimator();
+
+	void setPeriod(int64_t period_ns);
+	int64_t getPeriod() const { return mPeriod; }
+	bool sample(int64_t timestamp);
+	bool sample(int64_t timestamp, const float in[3], float out[3]);
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_DECIMATOR_H */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#if (ANDROID_VERSION >= ANDROID_O)
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <cutils/log.h>
+
+#include "DirectChannel.h"
+#include "SensorBase.h"
+
+/*****************************************************************************/
+
+DirectChannel::DirectChannel(const struct sensors_direct_mem_t* mem)
+	: mRing(NULL),
+	mMapSize(0),
+	mSize(0),
+	mWritePos(0),
+	mCounter(1)
+{
+	void* addr;
+
+	memset(mPeriod, 0, sizeof(mPeriod));
+	memset(mNextTimestamp, 0, sizeof(mNextTimestamp));
+
+	if ((mem->type != SENSOR_DIRECT_MEM_TYPE_ASHMEM) ||
+	    (mem->format != SENSOR_DIRECT_FMT_SENSORS_EVENT) ||
+	    !mem->handle || (mem->handle->numFds < 1) ||
+	    (mem->size < sizeof(sensors_event_t))) {
+		STLOGE("DirectChannel: unsupported memory (type=%d, format=%d)",
+						mem->type, mem->format);
+		return;
+	}
+
+	addr = mmap(NULL, mem->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+						mem->handle->data[0], 0);
+	if (addr == MAP_FAILED) {
+		STLOGE("DirectChannel: mmap failed (%s)", strerror(errno));
+		return;
+	}
+
+	mRing = (sensors_event_t *)addr;
+	mMapSize = mem->size;
+	mSize = mem->size / sizeof(sensors_event_t);
+}
+
+DirectChannel::~DirectChannel()
+{
+	if (mRing)
+		munmap(mRing, mMapSize);
+}
+
+bool DirectChannel::isValid() const
+{
+	return mRing != NULL;
+}
+
+/*
+ * Nominal rates of the direct report levels: 50Hz, 200Hz and 800Hz.
+ */
+int64_t DirectChannel::rateLevelToPeriod(int rateLevel)
+{
+	switch (rateLevel) {
+	case SENSOR_DIRECT_RATE_STOP:
+		return 0;
+	case SENSOR_DIRECT_RATE_NORMAL:
+		return MSEC_TO_NSEC(20LL);
+	case SENSOR_DIRECT_RATE_FAST:
+		return MSEC_TO_NSEC(5LL);
+	case SENSOR_DIRECT_RATE_VERY_FAST:
+		return 1250000LL;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Return the report token of the handle (the handle itself), 0 if the
+ * report has been stopped.
+ */
+int DirectChannel::configure(int handle, int rateLevel)
+{
+	int64_t period = rateLevelToPeriod(rateLevel);
+
+	if ((period < 0) || (handle < 0) || (handle >= SENSORS_HANDLE_COUNT))
+		return -EINVAL;
+
+	mPeriod[handle] = period;
+	mNextTimestamp[handle] = 0;
+
+	return period ? handle : 0;
+}
+
+int64_t DirectChannel::getPeriod(int handle) const
+{
+	return mPeriod[handle];
+}
+
+/*
+ * Events faster than the channel rate (10% of jitter allowed) are
+ * skipped. The record is invalidated while it is written and published
+ * by its atomic counter, which is never 0.
+ */
+void DirectChannel::write(const sensors_event_t* event)
+{
+	int handle = event->sensor;
+	sensors_event_t record;
+	sensors_event_t* slot;
+
+	if ((handle < 0) || (handle >= SENSORS_HANDLE_COUNT) || !mPeriod[handle])
+		return;
+
+	if (event->timestamp < mNextTimestamp[handle])
+		return;
+
+	mNextTimestamp[handle] = event->timestamp + mPeriod[handle] - mPeriod[handle] / 10;
+
+	record = *event;
+	record.version = sizeof(sensors_event_t);
+	record.reserved0 = 0;
+
+	slot = &mRing[mWritePos];
+	((volatile sensors_event_t *)slot)->reserved0 = 0;
+	__sync_synchronize();
+	memcpy(slot, &record, sizeof(record));
+	__sync_synchronize();
+	((volatile sensors_event_t *)slot)->reserved0 = mCounter;
+
+	if (!++mCounter)
+		mCounter = 1;
+
+	mWritePos = (mWritePos + 1) % mSize;
+}
+
+#endif /* ANDROID_VERSION >= ANDROID_O */
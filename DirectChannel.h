@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#if (ANDROID_VERSION >= ANDROID_O)
+
+#ifndef ANDROID_DIRECT_CHANNEL_H
+#define ANDROID_DIRECT_CHANNEL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/*****************************************************************************/
+
+/**
+ * Direct report channel on a shared memory region registered by the
+ * framework. Events are written as sensors_event_t records in a ring;
+ * the reserved0 field of each record carries the atomic counter that
+ * consumers use to detect new data, so no copy through poll is needed.
+ */
+class DirectChannel {
+	sensors_event_t* mRing;
+	size_t mMapSize;
+	size_t mSize;
+	size_t mWritePos;
+	uint32_t mCounter;
+	int64_t mPeriod[SENSORS_HANDLE_COUNT];
+	int64_t mNextTimestamp[SENSORS_HANDLE_COUNT];
+
+public:
+	DirectChannel(const struct sensors_direct_mem_t* mem);
+	~DirectChannel();
+
+	bool isValid() const;
+	int configure(int handle, int rateLevel);
+	int64_t getPeriod(int handle) const;
+	void write(const sensors_event_t* event);
+
+	static int64_t rateLevelToPeriod(int rateLevel);
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_DIRECT_CHANNEL_H */
+
+#endif /* ANDROID_VERSION >= ANDROID_O */
@@ -33,32 +33,62 @@
 #define FETCH_FULL_EVENT_BEFORE_RETURN		0
 
 /*****************************************************************************/
-sensors_vec_t  GyroSensor::dataBuffer;
-int GyroSensor::mEnabled = 0;
-int64_t GyroSensor::delayms = 0;
-int GyroSensor::startup_samples = DEFAULT_SAMPLES_TO_DISCARD;
-int GyroSensor::current_fullscale = 0;
-int GyroSensor::samples_to_discard = DEFAULT_SAMPLES_TO_DISCARD;
-float GyroSensor::gbias_out[3] = {0};
-int64_t GyroSensor::setDelayBuffer[numSensors] = {0};
-int64_t GyroSensor::writeDelayBuffer[numSensors] = {0};
-int GyroSensor::DecimationBuffer[numSensors] = {0};
-int GyroSensor::DecimationCount[numSensors] = {0};
-pthread_mutex_t GyroSensor::dataMutex;
-#if (SENSORS_ACCELEROMETER_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
-AccelSensor* GyroSensor::acc = NULL;
-#endif
+GyroSensor* GyroSensor::single = NULL;
 
-GyroSensor::GyroSensor()
-	: SensorBase(NULL, SENSOR_DATANAME_GYROSCOPE),
+/*
+ * Every logical sensor built on the gyroscope shares the same instance,
+ * so the input device is opened and decoded only once.
+ * Extra IMUs of the same model are plain instances owned by the poll
+ * context, each reporting under its own handle.
+ */
+GyroSensor* GyroSensor::getInstance()
+{
+	if (!single)
+		single = new GyroSensor();
+	else
+		single->get();
+
+	return single;
+}
+
+GyroSensor::GyroSensor(int instance, int32_t handle)
+#if (GYRO_IIO_ENABLE == 1)
+	: SensorBase(NULL, NULL),
+	mInstance(instance),
+	mHandle(handle),
+	mInputReader(6),
+	mHasPendingEvent(false),
+	mIIOReader(GYRO_IIO_CHANNEL)
+#else
+	: SensorBase(NULL, SENSOR_DATANAME_GYROSCOPE, instance),
+	mInstance(instance),
+	mHandle(handle),
 	mInputReader(6),
 	mHasPendingEvent(false)
+#endif
 {
-	pthread_mutex_init(&dataMutex, NULL);
+	mEnabled = 0;
+	delayms = 0;
+	current_fullscale = 0;
+	startup_samples = DEFAULT_SAMPLES_TO_DISCARD;
+	samples_to_discard = DEFAULT_SAMPLES_TO_DISCARD;
+	memset(gbias_out, 0, sizeof(gbias_out));
+	memset(setDelayBuffer, 0, sizeof(setDelayBuffer));
+	memset(writeDelayBuffer, 0, sizeof(writeDelayBuffer));
+
+	mTransformValid = false;
+
+#if (GYRO_IIO_ENABLE == 1)
+	data_fd = openIIO(SENSOR_IIO_GYROSCOPE, instance);
+	if ((data_fd >= 0) && (mIIOReader.setup(sysfs_device_path) < 0)) {
+		close(data_fd);
+		data_fd = -1;
+	}
+#endif
 
 #if (GYROSCOPE_GBIAS_ESTIMATION_FUSION == 0)
 	mPendingEvent[Gyro].version = sizeof(sensors_event_t);
-	mPendingEvent[Gyro].sensor = ID_GYROSCOPE;
+	mPendingEvent[Gyro].sensor = handle;
 	mPendingEvent[Gyro].type = SENSOR_TYPE_GYROSCOPE;
 	mPendingEvent[Gyro].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
 
@@ -72,6 +102,7 @@ GyroSensor::GyroSensor()
 
 #if defined(STORE_CALIB_GYRO_ENABLED)
 	pStoreCalibration = StoreCalibration::getInstance();
+	mCalibSerial = 0;
 #endif
 
 	if (data_fd) {
@@ -83,22 +114,30 @@ GyroSensor::GyroSensor()
 	memset(data_raw, 0, sizeof(data_raw));
 
 #if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
-	iNemoEngine_API_gbias_Initialization(false);
+	/* The bias estimator library has a single state, owned by instance 0 */
   #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	acc = new AccelSensor();
+	acc = NULL;
   #endif
+	if (mInstance == 0) {
+		iNemoEngine_API_gbias_Initialization(false);
+  #if (SENSORS_ACCELEROMETER_ENABLE == 1)
+		acc = AccelSensor::getInstance();
+  #endif
+	}
 #endif
 }
 
 GyroSensor::~GyroSensor()
 {
 	if (mEnabled) {
-		enable(SENSORS_GYROSCOPE_HANDLE, 0, 0);
+		enable(mHandle, 0, 0);
 	}
 #if ((SENSORS_ACCELEROMETER_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1))
-	acc->~AccelSensor();
+	if (acc)
+		acc->put();
 #endif
-	pthread_mutex_destroy(&dataMutex);
+	if (single == this)
+		single = NULL;
 }
 
 #if !defined(NOT_SET_GYRO_INITIAL_STATE)
@@ -112,12 +151,11 @@ int GyroSensor::setInitialState()
 		!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_GYRO_Y), &absinfo_y) &&
 		!ioctl(data_fd, EVIOCGABS(EVENT_TYPE_GYRO_Z), &absinfo_z))
 	{
-		mHasPendingEvent = true;	static int DecimationBuffer[numSensors];
+		mHasPendingEvent = true;
 	}
 
 	setFullScale(SENSORS_GYROSCOPE_HANDLE, GYRO_DEFAULT_FULLSCALE);
 	startup_samples = samples_to_discard;
-	memset(DecimationCount, 0, sizeof(DecimationCount));
 
 	return 0;
 }
@@ -127,10 +165,10 @@ int GyroSensor::getWhatFromHandle(int32_t handle)
 {
 	int what = -1;
 
+	if (handle == mHandle)
+		return Gyro;
+
 	switch(handle) {
-		case SENSORS_GYROSCOPE_HANDLE:
-			what = Gyro;
-			break;
 #if ((SENSORS_UNCALIB_GYROSCOPE_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1))
 		case SENSORS_UNCALIB_GYROSCOPE_HANDLE:
 			what = GyroUncalib;
@@ -165,8 +203,10 @@ int GyroSensor::enable(int32_t handle, int en, int  __attribute__((unused))type)
 
 		if (mEnabled == (1<<what)) {
 #if ((GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1) && (SENSORS_ACCELEROMETER_ENABLE == 1))
-			acc->enable(SENSORS_GYROSCOPE_HANDLE, flags, 1);
-			iNemoEngine_API_gbias_enable(flags);
+			if (acc) {
+				acc->enable(SENSORS_GYROSCOPE_HANDLE, flags, 1);
+				iNemoEngine_API_gbias_enable(flags);
+			}
 #endif
 #if !defined(NOT_SET_GYRO_INITIAL_STATE)
 			setInitialState();
@@ -186,9 +226,11 @@ int GyroSensor::enable(int32_t handle, int en, int  __attribute__((unused))type)
 				err = 0;
 
 #if ((GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1) && (SENSORS_ACCELEROMETER_ENABLE == 1))
-			acc->enable(SENSORS_GYROSCOPE_HANDLE, flags, 1);
-			STLOGD("GyroSensor::Acc OFF");
-			iNemoEngine_API_gbias_enable(false);
+			if (acc) {
+				acc->enable(SENSORS_GYROSCOPE_HANDLE, flags, 1);
+				STLOGD("GyroSensor::Acc OFF");
+				iNemoEngine_API_gbias_enable(false);
+			}
 #endif
 
 		}
@@ -230,10 +272,12 @@ int GyroSensor::setDelay(int32_t handle, int64_t delay_ns)
 
 #if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
   #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	if (delay_ns >= 10000000)
-		acc->setDelay(SENSORS_GYROSCOPE_HANDLE, delay_ns);
-	else
-		acc->setDelay(SENSORS_GYROSCOPE_HANDLE, 10000000);
+	if (acc) {
+		if (delay_ns >= 10000000)
+			acc->setDelay(SENSORS_GYROSCOPE_HANDLE, delay_ns);
+		else
+			acc->setDelay(SENSORS_GYROSCOPE_HANDLE, 10000000);
+	}
 
   #endif
 #endif
@@ -261,6 +305,15 @@ int GyroSensor::setDelay(int32_t handle, int64_t delay_ns)
 	return err;
 }
 
+int GyroSensor::setLatency(int64_t latency_ns)
+{
+	SensorBase::setLatency(latency_ns);
+	mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+				MSEC_TO_NSEC(delayms), report_latency));
+
+	return 0;
+}
+
 int GyroSensor::writeMinDelay(void)
 {
 	int err = 0;
@@ -295,15 +348,20 @@ int GyroSensor::writeMinDelay(void)
 		if(err >= 0) {
 			err = 0;
 			delayms = Min_delay_ms;
-			memset(DecimationCount, 0, sizeof(DecimationCount));
+			mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+					MSEC_TO_NSEC(delayms), report_latency));
+			mTimestampEstimator.setPeriod(MSEC_TO_NSEC(delayms));
 #if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
-			iNemoEngine_API_gbias_set_frequency(1000.0f /
+			if (mInstance == 0)
+				iNemoEngine_API_gbias_set_frequency(1000.0f /
 							(float)Min_delay_ms);
   #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			if (Min_delay_ms >= 10)
-				acc->setDelay(SENSORS_GYROSCOPE_HANDLE,(float)Min_delay_ms*1000000);
-			else
-				acc->setDelay(SENSORS_GYROSCOPE_HANDLE,10000000);
+			if (acc) {
+				if (Min_delay_ms >= 10)
+					acc->setDelay(SENSORS_GYROSCOPE_HANDLE,(float)Min_delay_ms*1000000);
+				else
+					acc->setDelay(SENSORS_GYROSCOPE_HANDLE,10000000);
+			}
   #endif
 #endif
 		}
@@ -312,20 +370,15 @@ int GyroSensor::writeMinDelay(void)
 	// Decimation Definition
 	for(kk = 0; kk < numSensors; kk++)
 	{
-		if (kk == Gyro || kk == GyroUncalib)
-			continue;
-
-		if (delayms)
-			DecimationBuffer[kk] = writeDelayBuffer[kk]/delayms;
-		else
-			DecimationBuffer[kk] = 0;
+		Decimation[kk].setPeriod(delayms ?
+				MSEC_TO_NSEC(writeDelayBuffer[kk]) : 0);
 	}
 
 #if (DEBUG_POLL_RATE == 1)
 	STLOGD("GyroSensor::writeDelayBuffer[] = %lld, %lld, %lld", writeDelayBuffer[0], writeDelayBuffer[1], writeDelayBuffer[2]);
 	STLOGD("GyroSensor::Min_delay_ms = %lld, delayms = %lld, mEnabled = %d", Min_delay_ms, delayms, mEnabled);
 	STLOGD("GyroSensor::samples_to_discard = %d", samples_to_discard);
-	STLOGD("GyroSensor::DecimationBuffer = %d, %d, %d", DecimationBuffer[0], DecimationBuffer[1], DecimationBuffer[2]);
+	STLOGD("GyroSensor::Decimation periods = %lld, %lld, %lld", Decimation[0].getPeriod(), Decimation[1].getPeriod(), Decimation[2].getPeriod());
 #endif
 
 	return err;
@@ -361,6 +414,133 @@ int GyroSensor::setFullScale(int32_t  __attribute__((unused))handle, int value)
 	return err;
 }
 
+/*
+ * Fold conversion factor, axis matrix and calibration into mTransform,
+ * only when the calibration changed since the last block.
+ */
+void GyroSensor::updateTransform()
+{
+#if (GYRO_IIO_ENABLE == 1)
+	const float iio_scale = mIIOReader.getScale();
+	const float scale[3] = { iio_scale, iio_scale, iio_scale };
+#else
+	static const float scale[3] = { CONVERT_GYRO_X, CONVERT_GYRO_Y, CONVERT_GYRO_Z };
+#endif
+#if defined(STORE_CALIB_GYRO_ENABLED)
+	float bias[3] = { 0.0f, 0.0f, 0.0f };
+	float sens[3] = { 1.0f, 1.0f, 1.0f };
+
+	/* The stored calibration belongs to the primary chip only */
+	if (mInstance == 0) {
+		if (!pStoreCalibration->isChanged(&mCalibSerial) && mTransformValid)
+			return;
+
+		for (int i = 0; i < 3; i++) {
+			bias[i] = pStoreCalibration->getCalibration(
+					StoreCalibration::GYROSCOPE_BIAS,
+					StoreCalibration::XAxis + i);
+			sens[i] = pStoreCalibration->getCalibration(
+					StoreCalibration::GYROSCOPE_SENS,
+					StoreCalibration::XAxis + i);
+		}
+	} else if (mTransformValid)
+		return;
+#else
+	static const float bias[3] = { 0.0f, 0.0f, 0.0f };
+	static const float sens[3] = { 1.0f, 1.0f, 1.0f };
+
+	if (mTransformValid)
+		return;
+#endif
+
+	mTransform.set(scale, matrix_gyr, bias, sens);
+	mTransformValid = true;
+}
+
+/*
+ * Run scale, axis remap and calibration over the decoded frames at once,
+ * then dispatch them one by one while there is room in data.
+ */
+int GyroSensor::processSamples(sensors_event_t* data, int count)
+{
+	int numEventReceived = 0;
+	int i;
+
+	updateTransform();
+	mSamples.transform(mTransform);
+
+	for (i = mSamples.first; (count > 0) && (i < mSamples.count); i++) {
+		data_rot[0] = mSamples.x[i];
+		data_rot[1] = mSamples.y[i];
+		data_rot[2] = mSamples.z[i];
+		timestamp = mSamples.timestamp[i];
+
+#if !(GYROSCOPE_GBIAS_ESTIMATION_FUSION == 1)
+		memset(gbias_out, 0, sizeof(gbias_out));
+#if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
+		if (mInstance == 0) {
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+			sensors_vec_t tmp_data_acc;
+			acc->getHistory()->readAt(&tmp_data_acc, timestamp);
+			memcpy(data_acc, tmp_data_acc.v, sizeof(float) * 3);
+#else
+			memset(data_acc, 0, sizeof(data_acc));
+#endif
+			iNemoEngine_API_gbias_Run(data_acc, data_rot);
+			iNemoEngine_API_Get_gbias(gbias_out);
+		}
+#endif
+		if (mEnabled & (1<<Gyro) && Decimation[Gyro].sample(timestamp,
+					data_rot, mPendingEvent[Gyro].data)) {
+			mPendingEvent[Gyro].data[0] -= gbias_out[0];
+			mPendingEvent[Gyro].data[1] -= gbias_out[1];
+			mPendingEvent[Gyro].data[2] -= gbias_out[2];
+			mPendingEvent[Gyro].timestamp = timestamp;
+			mPendingEvent[Gyro].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
+
+			*data++ = mPendingEvent[Gyro];
+			count--;
+			numEventReceived++;
+		}
+
+  #if ((SENSORS_UNCALIB_GYROSCOPE_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1))
+		if (mEnabled & (1<<GyroUncalib) && Decimation[GyroUncalib].sample(timestamp,
+					data_rot, mPendingEvent[GyroUncalib].uncalibrated_gyro.uncalib)) {
+			mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[0] = gbias_out[0];
+			mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[1] = gbias_out[1];
+			mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[2] = gbias_out[2];
+			mPendingEvent[GyroUncalib].timestamp = timestamp;
+			mPendingEvent[GyroUncalib].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
+
+			*data++ = mPendingEvent[GyroUncalib];
+			count--;
+			numEventReceived++;
+		}
+  #endif
+#endif
+		if(mEnabled & (1<<iNemoGyro)) {
+			sensors_vec_t sData;
+			sData.x = data_rot[0] - gbias_out[0];
+			sData.y = data_rot[1] - gbias_out[1];
+			sData.z = data_rot[2] - gbias_out[2];
+			setBufferData(&sData, timestamp);
+		}
+
+#if (DEBUG_GYROSCOPE == 1)
+		STLOGD("GyroSensor::readEvents (time = %lld), count(%d), received(%d)",
+					mPendingEvent[Gyro].timestamp,
+					count, numEventReceived);
+#endif
+	}
+
+	mSamples.consume(i - mSamples.first);
+
+	/* Wake the drivers clocked by this one (fusion, virtual gyroscope) */
+	dataBuffer.notify();
+
+	return numEventReceived;
+}
+
 int GyroSensor::readEvents(sensors_event_t* data, int count)
 {
 	if (count < 1)
@@ -370,6 +550,20 @@ int GyroSensor::readEvents(sensors_event_t* data, int count)
 		mHasPendingEvent = false;
 	}
 
+#if (GYRO_IIO_ENABLE == 1)
+	/* Scans are decoded straight into mSamples, timestamps included */
+	ssize_t n = mIIOReader.fill(data_fd, &mSamples, count - mSamples.pending());
+	if (n < 0)
+		return n;
+
+	/* Drop the samples output while the gyroscope settles */
+	while (startup_samples && mSamples.pending()) {
+		mSamples.consume(1);
+		startup_samples--;
+	}
+
+	return processSamples(data, count);
+#else
 	ssize_t n = mInputReader.fill(data_fd);
 	if (n < 0)
 		return n;
@@ -381,7 +575,25 @@ int GyroSensor::readEvents(sensors_event_t* data, int count)
 	again:
 #endif
 
-	while (count && mInputReader.readEvent(&event)) {
+	while (count > 0) {
+		bool more = mInputReader.readEvent(&event);
+
+		/*
+		 * Frames are decoded into mSamples and processed as a block when
+		 * it is full, when the input is drained or before any other event.
+		 */
+		if (mSamples.pending() && (!more || mSamples.isFull() ||
+					(mSamples.pending() >= count) ||
+					((event->type != EVENT_TYPE_GYRO) && (event->type != EV_SYN)))) {
+			int nb = processSamples(data, count);
+			data += nb;
+			count -= nb;
+			numEventReceived += nb;
+			continue;
+		}
+
+		if (!more)
+			break;
 
 		if (event->type == EVENT_TYPE_GYRO) {
 
@@ -391,13 +603,13 @@ int GyroSensor::readEvents(sensors_event_t* data, int count)
 
 			float value = (float) event->value;
 			if (event->code == EVENT_TYPE_GYRO_X) {
-				data_raw[0] = value * CONVERT_GYRO_X;
+				data_raw[0] = value;
 			}
 			else if (event->code == EVENT_TYPE_GYRO_Y) {
-				data_raw[1] = value * CONVERT_GYRO_Y;
+				data_raw[1] = value;
 			}
 			else if (event->code == EVENT_TYPE_GYRO_Z) {
-				data_raw[2] = value * CONVERT_GYRO_Z;
+				data_raw[2] = value;
 			}
 #if defined(GYRO_EVENT_HAS_TIMESTAMP)
 			else if (event->code == EVENT_TYPE_TIME_MSB) {
@@ -421,102 +633,10 @@ int GyroSensor::readEvents(sensors_event_t* data, int count)
 				goto no_data;
 			}
 
-			data_rot[0] = data_raw[0]*matrix_gyr[0][0] +
-					data_raw[1]*matrix_gyr[1][0] +
-					data_raw[2]*matrix_gyr[2][0];
-			data_rot[1] = data_raw[0]*matrix_gyr[0][1] +
-					data_raw[1]*matrix_gyr[1][1] +
-					data_raw[2]*matrix_gyr[2][1];
-			data_rot[2] = data_raw[0]*matrix_gyr[0][2] +
-					data_raw[1]*matrix_gyr[1][2] +
-					data_raw[2]*matrix_gyr[2][2];
-
-#if defined(STORE_CALIB_GYRO_ENABLED)
-			data_rot[0] -= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_BIAS,
-					StoreCalibration::XAxis);
-			data_rot[1] -= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_BIAS,
-					StoreCalibration::YAxis);
-			data_rot[2] -= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_BIAS,
-					StoreCalibration::ZAxis);
-			data_rot[0] *= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_SENS,
-					StoreCalibration::XAxis);
-			data_rot[1] *= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_SENS,
-					StoreCalibration::YAxis);
-			data_rot[2] *= pStoreCalibration->getCalibration(
-					StoreCalibration::GYROSCOPE_SENS,
-					StoreCalibration::ZAxis);
-#endif
-
 #if !defined(GYRO_EVENT_HAS_TIMESTAMP)
-			timestamp = timevalToNano(event->time);
+			timestamp = mTimestampEstimator.estimate(timevalToNano(event->time));
 #endif
-
-#if !(GYROSCOPE_GBIAS_ESTIMATION_FUSION == 1)
-			memset(gbias_out, 0, sizeof(gbias_out));
-#if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
-			int bias_meas;
-#if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			sensors_vec_t tmp_data_acc;
-			AccelSensor::getBufferData(&tmp_data_acc);
-			memcpy(data_acc, tmp_data_acc.v, sizeof(float) * 3);
-#else
-			memset(data_acc, 0, sizeof(data_acc));
-#endif
-			iNemoEngine_API_gbias_Run(data_acc, data_rot);
-			iNemoEngine_API_Get_gbias(gbias_out);
-#endif
-			DecimationCount[Gyro]++;
-			if(mEnabled & (1<<Gyro) && (DecimationCount[Gyro] >= DecimationBuffer[Gyro])) {
-				DecimationCount[Gyro] = 0;
-				mPendingEvent[Gyro].data[0] = data_rot[0] - gbias_out[0];
-				mPendingEvent[Gyro].data[1] = data_rot[1] - gbias_out[1];
-				mPendingEvent[Gyro].data[2] = data_rot[2] - gbias_out[2];
-				mPendingEvent[Gyro].timestamp = timestamp;
-				mPendingEvent[Gyro].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-				*data++ = mPendingEvent[Gyro];
-				count--;
-				numEventReceived++;
-			}
-
-  #if ((SENSORS_UNCALIB_GYROSCOPE_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1))
-			DecimationCount[GyroUncalib]++;
-			if(mEnabled & (1<<GyroUncalib) && (DecimationCount[GyroUncalib] >= DecimationBuffer[GyroUncalib])) {
-				DecimationCount[GyroUncalib] = 0;
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.uncalib[0] = data_rot[0];
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.uncalib[1] = data_rot[1];
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.uncalib[2] = data_rot[2];
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[0] = gbias_out[0];
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[1] = gbias_out[1];
-				mPendingEvent[GyroUncalib].uncalibrated_gyro.bias[2] = gbias_out[2];
-				mPendingEvent[GyroUncalib].timestamp = timestamp;
-				mPendingEvent[GyroUncalib].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
-
-				*data++ = mPendingEvent[GyroUncalib];
-				count--;
-				numEventReceived++;
-			}
-  #endif
-#endif
-			if(mEnabled & (1<<iNemoGyro)) {
-				sensors_vec_t sData;
-				sData.x = data_rot[0] - gbias_out[0];
-				sData.y = data_rot[1] - gbias_out[1];
-				sData.z = data_rot[2] - gbias_out[2];
-				setBufferData(&sData);
-			}
-
-#if (DEBUG_GYROSCOPE == 1)
-			STLOGD("GyroSensor::readEvents (time = %lld), count(%d), received(%d)",
-						mPendingEvent[Gyro].timestamp,
-						count, numEventReceived);
-#endif
-
+			mSamples.push(data_raw, timestamp);
 		} else {
 			STLOGE("GyroSensor: unknown event (type=%d, code=%d)",
 						event->type, event->code);
@@ -536,29 +656,17 @@ no_data:
 #endif
 
 	return numEventReceived;
+#endif
 }
 
-bool GyroSensor::setBufferData(sensors_vec_t *value)
+SensorHistory* GyroSensor::getHistory()
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(&dataBuffer, value, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
-
-	return true;
+	return &dataBuffer;
 }
 
-bool GyroSensor::getBufferData(sensors_vec_t *lastBufferedValues)
+bool GyroSensor::setBufferData(sensors_vec_t *value, int64_t timestamp)
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(lastBufferedValues, &dataBuffer, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
-
-#if (DEBUG_GYROSCOPE == 1)
-	STLOGD("GyroSensor: getBufferData got values: x:(%f),y:(%f), z:(%f).",
-						lastBufferedValues->x,
-						lastBufferedValues->y,
-						lastBufferedValues->z);
-#endif
+	dataBuffer.write(value, timestamp);
 
 	return true;
 }
@@ -29,7 +29,14 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
+#include "Decimator.h"
+#include "SensorHistory.h"
 #include "InputEventReader.h"
+#include "SampleBlock.h"
+#include "TimestampEstimator.h"
+#if (GYRO_IIO_ENABLE == 1)
+#include "IIOBufferReader.h"
+#endif
 #include "AccelSensor.h"
 
 #if defined(STORE_CALIB_GYRO_ENABLED)
@@ -55,47 +62,62 @@ class GyroSensor : public SensorBase
 		iNemoGyro,
 		numSensors
 	};
-	static int mEnabled;
-	static int64_t delayms;
-	static int current_fullscale;
+	int mInstance;
+	int32_t mHandle;
+	int mEnabled;
+	int64_t delayms;
+	int current_fullscale;
 	InputEventCircularReader mInputReader;
 	sensors_event_t mPendingEvent[numSensors];
 	bool mHasPendingEvent;
 	int setInitialState();
 
 private:
-	static int startup_samples;
-	static int samples_to_discard;
-	static sensors_vec_t  dataBuffer;
-	static int64_t setDelayBuffer[numSensors];
-	static int64_t writeDelayBuffer[numSensors];
-	static int DecimationBuffer[numSensors];
-	static int DecimationCount[numSensors];
-	virtual bool setBufferData(sensors_vec_t *value);
-	static float gbias_out[3];
+	int startup_samples;
+	int samples_to_discard;
+	SensorHistory dataBuffer;
+	int64_t setDelayBuffer[numSensors];
+	int64_t writeDelayBuffer[numSensors];
+	Decimator Decimation[numSensors];
+	virtual bool setBufferData(sensors_vec_t *value, int64_t timestamp);
+	float gbias_out[3];
 	float data_raw[3];
 	float data_rot[3];
-	static pthread_mutex_t dataMutex;
+	SampleBlock mSamples;
+	SampleTransform mTransform;
+	bool mTransformValid;
+	TimestampEstimator mTimestampEstimator;
+#if (GYRO_IIO_ENABLE == 1)
+	IIOBufferReader mIIOReader;
+#endif
 	int64_t timestamp;
 #if defined(STORE_CALIB_GYRO_ENABLED)
 	StoreCalibration *pStoreCalibration;
+	unsigned int mCalibSerial;
 #endif
 #if ((SENSORS_ACCELEROMETER_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1))
-	static AccelSensor *acc;
+	AccelSensor *acc;
 	float data_acc[3];
 #endif
 
+	static GyroSensor* single;
+
+	void updateTransform();
+	int processSamples(sensors_event_t* data, int count);
+
 public:
-	GyroSensor();
+	static GyroSensor* getInstance();
+	GyroSensor(int instance = 0, int32_t handle = SENSORS_GYROSCOPE_HANDLE);
 	virtual ~GyroSensor();
 	virtual int readEvents(sensors_event_t *data, int count);
 	virtual bool hasPendingEvents() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
+	virtual int setLatency(int64_t latency_ns);
 	virtual int writeMinDelay(void);
 	virtual int setFullScale(int32_t handle, int value);
 	virtual int enable(int32_t handle, int enabled, int type);
-	static bool getBufferData(sensors_vec_t *lastBufferedValues);
-	static void getGyroDelay(int64_t *Gyro_Delay_ms);
+	SensorHistory* getHistory();
+	void getGyroDelay(int64_t *Gyro_Delay_ms);
 	virtual int getWhatFromHandle(int32_t handle);
 };
 
@@ -0,0 +1,303 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+#include <cutils/log.h>
+
+#include "configuration.h"
+#include "IIOBufferReader.h"
+
+/*****************************************************************************/
+
+static int readSysfs(const char* dir, const char* file, char* buf, int len)
+{
+	char path[PATH_MAX];
+	int fd, nread;
+
+	snprintf(path, sizeof(path), "%s%s", dir, file);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	nread = read(fd, buf, len - 1);
+	close(fd);
+	if (nread < 0)
+		return -errno;
+
+	buf[nread] = '\0';
+
+	return nread;
+}
+
+static int writeSysfs(const char* dir, const char* file, const char* value)
+{
+	char path[PATH_MAX];
+	int fd, err;
+
+	snprintf(path, sizeof(path), "%s%s", dir, file);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	err = write(fd, value, strlen(value));
+	close(fd);
+
+	return (err < 0) ? -errno : 0;
+}
+
+IIOBufferReader::IIOBufferReader(const char* channel)
+	: mChannel(channel),
+	mScanSize(0),
+	mScale(1.0f)
+{
+	memset(mAxis, 0, sizeof(mAxis));
+	memset(&mTimestamp, 0, sizeof(mTimestamp));
+}
+
+/*
+ * Enable the scan element name and parse its index and storage format,
+ * e.g. "le:s16/16>>0".
+ */
+int IIOBufferReader::setupChannel(const char* sysfsPath, const char* name,
+					struct scan_channel* channel)
+{
+	char file[NAME_MAX], buf[32];
+	char endian, sign;
+
+	snprintf(file, sizeof(file), "scan_elements/%s_en", name);
+	if (writeSysfs(sysfsPath, file, "1") < 0)
+		return -1;
+
+	snprintf(file, sizeof(file), "scan_elements/%s_index", name);
+	if (readSysfs(sysfsPath, file, buf, sizeof(buf)) < 0)
+		return -1;
+
+	channel->index = atoi(buf);
+
+	snprintf(file, sizeof(file), "scan_elements/%s_type", name);
+	if (readSysfs(sysfsPath, file, buf, sizeof(buf)) < 0)
+		return -1;
+
+	if (sscanf(buf, "%ce:%c%d/%d>>%d", &endian, &sign, &channel->bits,
+				&channel->bytes, &channel->shift) != 5)
+		return -1;
+
+	channel->bytes /= 8;
+	channel->big_endian = (endian == 'b');
+	channel->is_signed = (sign == 's');
+
+	if ((channel->bytes != 1) && (channel->bytes != 2) &&
+			(channel->bytes != 4) && (channel->bytes != 8))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Select the three axes and the timestamp as the only scan elements and
+ * compute their offsets in the scan: elements are stored by index, each
+ * one aligned to its own size.
+ */
+int IIOBufferReader::setup(const char* sysfsPath)
+{
+	struct scan_channel* order[4] = { &mAxis[0], &mAxis[1], &mAxis[2], &mTimestamp };
+	char name[NAME_MAX], dir[PATH_MAX], buf[32];
+	const char axis[3] = { 'x', 'y', 'z' };
+	struct dirent* entry;
+	int i, j, offset = 0, align = 1;
+	DIR* scan_dir;
+
+	writeSysfs(sysfsPath, IIO_BUFFER_ENABLE_FILE_NAME, "0");
+
+	/* Other channels would change the scan layout */
+	snprintf(dir, sizeof(dir), "%sscan_elements", sysfsPath);
+	scan_dir = opendir(dir);
+	if (!scan_dir) {
+		STLOGE("IIOBufferReader: no scan elements in %s", sysfsPath);
+		return -1;
+	}
+	while ((entry = readdir(scan_dir)) != NULL) {
+		int len = strlen(entry->d_name);
+		if ((len > 3) && !strcmp(&entry->d_name[len - 3], "_en")) {
+			snprintf(name, sizeof(name), "scan_elements/%s", entry->d_name);
+			writeSysfs(sysfsPath, name, "0");
+		}
+	}
+	closedir(scan_dir);
+
+	for (i = 0; i < 3; i++) {
+		snprintf(name, sizeof(name), "in_%s_%c", mChannel, axis[i]);
+		if (setupChannel(sysfsPath, name, &mAxis[i]) < 0) {
+			STLOGE("IIOBufferReader: failed to enable %s", name);
+			return -1;
+		}
+	}
+
+	if (setupChannel(sysfsPath, "in_timestamp", &mTimestamp) < 0) {
+		STLOGE("IIOBufferReader: failed to enable in_timestamp");
+		return -1;
+	}
+
+	for (i = 1; i < 4; i++) {
+		for (j = i; (j > 0) && (order[j - 1]->index > order[j]->index); j--) {
+			struct scan_channel* tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		offset = (offset + order[i]->bytes - 1) / order[i]->bytes * order[i]->bytes;
+		order[i]->offset = offset;
+		offset += order[i]->bytes;
+		if (order[i]->bytes > align)
+			align = order[i]->bytes;
+	}
+
+	mScanSize = (offset + align - 1) / align * align;
+	if (mScanSize > IIO_SCAN_MAX_BYTES) {
+		STLOGE("IIOBufferReader: scan of %d bytes not supported", mScanSize);
+		return -1;
+	}
+
+	snprintf(name, sizeof(name), "in_%s_scale", mChannel);
+	if (readSysfs(sysfsPath, name, buf, sizeof(buf)) > 0)
+		mScale = strtof(buf, NULL);
+
+	/* Same time base as the rest of the HAL, on kernels supporting it */
+#if (SENSORS_CLOCK_ID == CLOCK_BOOTTIME)
+	if (writeSysfs(sysfsPath, IIO_TIMESTAMP_CLOCK_FILE_NAME, "boottime") < 0)
+#endif
+		writeSysfs(sysfsPath, IIO_TIMESTAMP_CLOCK_FILE_NAME, "monotonic");
+
+	snprintf(buf, sizeof(buf), "%d", IIO_BUFFER_LENGTH);
+	if (writeSysfs(sysfsPath, IIO_BUFFER_LENGTH_FILE_NAME, buf) < 0)
+		STLOGE("IIOBufferReader: failed to set buffer length");
+
+	STLOGI("IIOBufferReader: %s scan of %d bytes, scale %f", mChannel,
+							mScanSize, mScale);
+
+	return 0;
+}
+
+int64_t IIOBufferReader::decode(const uint8_t* scan, const struct scan_channel* channel)
+{
+	const uint8_t* p = scan + channel->offset;
+	uint64_t value = 0;
+	int i;
+
+	for (i = 0; i < channel->bytes; i++) {
+		if (channel->big_endian)
+			value = (value << 8) | p[i];
+		else
+			value |= (uint64_t)p[i] << (8 * i);
+	}
+
+	value >>= channel->shift;
+	if (channel->bits < 64) {
+		value &= (1ULL << channel->bits) - 1;
+		if (channel->is_signed && (value & (1ULL << (channel->bits - 1))))
+			value |= ~((1ULL << channel->bits) - 1);
+	}
+
+	return (int64_t)value;
+}
+
+/*
+ * Read at most maxFrames scans with a single read() and append them to
+ * block as raw x/y/z counts. Return the number of frames added.
+ */
+ssize_t IIOBufferReader::fill(int fd, SampleBlock* block, int maxFrames)
+{
+	int room = SAMPLE_BLOCK_SIZE - block->count;
+	ssize_t nread;
+	float raw[3];
+	int i, n;
+
+	if (!mScanSize)
+		return -EINVAL;
+
+	if (maxFrames < room)
+		room = maxFrames;
+
+	if (room <= 0)
+		return 0;
+
+	nread = read(fd, mBuffer, room * mScanSize);
+	if (nread < 0)
+		return (errno == EAGAIN) ? 0 : -errno;
+
+	n = nread / mScanSize;
+	for (i = 0; i < n; i++) {
+		const uint8_t* scan = &mBuffer[i * mScanSize];
+
+		raw[0] = (float)decode(scan, &mAxis[0]);
+		raw[1] = (float)decode(scan, &mAxis[1]);
+		raw[2] = (float)decode(scan, &mAxis[2]);
+		block->push(raw, decode(scan, &mTimestamp));
+	}
+
+	return n;
+}
+
+/*
+ * Format in buf the lowest rate listed in sampling_frequency_available
+ * that is not slower than 1000 / delay_ms Hz, or the fastest one.
+ */
+void IIOBufferReader::frequencyFor(const char* sysfsPath, int64_t delay_ms,
+							char* buf, int len)
+{
+	double wanted = delay_ms ? 1000.0 / delay_ms : 0.0;
+	double best = -1.0, fastest = -1.0;
+	char avail[128], *token, *save;
+	const char *best_str = NULL, *fastest_str = NULL;
+
+	snprintf(buf, len, "%lld", delay_ms ? 1000LL / delay_ms : 0LL);
+
+	if (readSysfs(sysfsPath, IIO_SAMPLING_FREQ_AVAIL_FILE_NAME,
+						avail, sizeof(avail)) <= 0)
+		return;
+
+	for (token = strtok_r(avail, " \n", &save); token;
+				token = strtok_r(NULL, " \n", &save)) {
+		double freq = strtod(token, NULL);
+
+		if (freq > fastest) {
+			fastest = freq;
+			fastest_str = token;
+		}
+
+		if ((freq >= wanted) && ((best < 0.0) || (freq < best))) {
+			best = freq;
+			best_str = token;
+		}
+	}
+
+	if (best_str)
+		snprintf(buf, len, "%s", best_str);
+	else if (fastest_str)
+		snprintf(buf, len, "%s", fastest_str);
+}
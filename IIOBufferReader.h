@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_IIO_BUFFER_READER_H
+#define ANDROID_IIO_BUFFER_READER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "SampleBlock.h"
+
+#define IIO_DEVICES_DIR				"/sys/bus/iio/devices/"
+#define IIO_BUFFER_ENABLE_FILE_NAME		"buffer/enable"
+#define IIO_BUFFER_LENGTH_FILE_NAME		"buffer/length"
+#define IIO_SAMPLING_FREQ_FILE_NAME		"sampling_frequency"
+#define IIO_SAMPLING_FREQ_AVAIL_FILE_NAME	"sampling_frequency_available"
+#define IIO_TIMESTAMP_CLOCK_FILE_NAME		"current_timestamp_clock"
+
+/* Kernel buffer depth, in scans */
+#define IIO_BUFFER_LENGTH			(256)
+/* Largest scan handled: three axes and the timestamp, 8 bytes each */
+#define IIO_SCAN_MAX_BYTES			(32)
+
+#define IIO_GAUSS_TO_UT				(100.0f)
+
+/*****************************************************************************/
+
+/**
+ * Read packed 3-axis scans from an IIO triggered buffer. The scan layout
+ * (in_<channel>_{x,y,z} and in_timestamp) is parsed from scan_elements, so
+ * one read() returns whole samples with their hardware timestamps.
+ */
+class IIOBufferReader
+{
+	struct scan_channel {
+		int index;
+		int offset;
+		int bytes;
+		int bits;
+		int shift;
+		bool is_signed;
+		bool big_endian;
+	};
+
+	const char* mChannel;
+	struct scan_channel mAxis[3];
+	struct scan_channel mTimestamp;
+	int mScanSize;
+	float mScale;
+	uint8_t mBuffer[SAMPLE_BLOCK_SIZE * IIO_SCAN_MAX_BYTES];
+
+	int setupChannel(const char* sysfsPath, const char* name,
+					struct scan_channel* channel);
+	static int64_t decode(const uint8_t* scan, const struct scan_channel* channel);
+
+public:
+	IIOBufferReader(const char* channel);
+
+	int setup(const char* sysfsPath);
+	ssize_t fill(int fd, SampleBlock* block, int maxFrames);
+	float getScale() const { return mScale; }
+
+	static void frequencyFor(const char* sysfsPath, int64_t delay_ms,
+							char* buf, int len);
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_IIO_BUFFER_READER_H */
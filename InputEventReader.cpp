@@ -39,7 +39,8 @@ InputEventCircularReader::InputEventCircularReader(size_t numEvents)
 	mBufferEnd(mBuffer + numEvents),
 	mHead(mBuffer),
 	mCurr(mBuffer),
-	mFreeSpace(numEvents)
+	mFreeSpace(numEvents),
+	mRequestedSize(0)
 {
 }
 
@@ -48,9 +49,74 @@ InputEventCircularReader::~InputEventCircularReader()
 	delete [] mBuffer;
 }
 
+/*
+ * Capacity needed to hold every sample produced at delay_ns during the
+ * report latency and the poll wake-up slack, so that a single read()
+ * drains the kernel queue.
+ */
+size_t InputEventCircularReader::capacityFor(int64_t delay_ns, int64_t latency_ns)
+{
+	int64_t frames;
+
+	if (delay_ns <= 0)
+		return 0;
+
+	if (latency_ns < 0)
+		latency_ns = 0;
+
+	frames = (latency_ns + INPUT_READER_SLACK_NS) / delay_ns + 1;
+	if (frames > INPUT_READER_MAX_EVENTS / INPUT_FRAME_MAX_EVENTS)
+		frames = INPUT_READER_MAX_EVENTS / INPUT_FRAME_MAX_EVENTS;
+
+	return frames * INPUT_FRAME_MAX_EVENTS;
+}
+
+/*
+ * May be called from any thread: the buffer is only reallocated by the
+ * next fill(), on the thread reading the events.
+ */
+void InputEventCircularReader::setCapacity(size_t numEvents)
+{
+	if (numEvents)
+		mRequestedSize = numEvents;
+}
+
+void InputEventCircularReader::resize(size_t numEvents)
+{
+	size_t size = mBufferEnd - mBuffer;
+	size_t available = size - mFreeSpace;
+	struct input_event* buffer;
+
+	if (numEvents < available)
+		numEvents = available;
+
+	if (numEvents == size)
+		return;
+
+	/* Move the events not consumed yet to the start of the new buffer */
+	buffer = new input_event[numEvents * 2];
+	for (size_t i = 0; i < available; i++) {
+		buffer[i] = *mCurr;
+		if (++mCurr >= mBufferEnd)
+			mCurr = mBuffer;
+	}
+
+	delete [] mBuffer;
+	mBuffer = buffer;
+	mBufferEnd = buffer + numEvents;
+	mHead = buffer + available;
+	mCurr = buffer;
+	mFreeSpace = numEvents - available;
+}
+
 ssize_t InputEventCircularReader::fill(int fd)
 {
 	size_t numEventsRead = 0;
+	size_t requested = __sync_lock_test_and_set(&mRequestedSize, 0);
+
+	if (requested)
+		resize(requested);
+
 	if (mFreeSpace) {
 		const ssize_t nread = read(fd, mHead, mFreeSpace * sizeof(input_event));
 		if (nread<0 || nread % sizeof(input_event)) {
@@ -59,6 +125,14 @@ ssize_t InputEventCircularReader::fill(int fd)
 
 		numEventsRead = nread / sizeof(input_event);
 		if (numEventsRead) {
+			/* Kernel queue possibly not drained: grow for the next fill */
+			size_t size = mBufferEnd - mBuffer;
+			if (((ssize_t)numEventsRead == mFreeSpace) &&
+					(size < INPUT_READER_MAX_EVENTS))
+				__sync_bool_compare_and_swap(&mRequestedSize, 0,
+						size * 2 < INPUT_READER_MAX_EVENTS ?
+						size * 2 : INPUT_READER_MAX_EVENTS);
+
 			mHead += numEventsRead;
 			mFreeSpace -= numEventsRead;
 			if (mHead > mBufferEnd) {
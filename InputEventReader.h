@@ -24,17 +24,26 @@
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
+/* Events per sample: x, y, z, two timestamp words and EV_SYN */
+#define INPUT_FRAME_MAX_EVENTS		(6)
+/* Poll wake-up delay the reader absorbs on top of the report latency */
+#define INPUT_READER_SLACK_NS		(50000000LL)
+#define INPUT_READER_MAX_EVENTS		(2048)
+
 /*****************************************************************************/
 
 struct input_event;
 
 class InputEventCircularReader
 {
-	struct input_event* const mBuffer;
-	struct input_event* const mBufferEnd;
+	struct input_event* mBuffer;
+	struct input_event* mBufferEnd;
 	struct input_event* mHead;
 	struct input_event* mCurr;
 	ssize_t mFreeSpace;
+	volatile size_t mRequestedSize;
+
+	void resize(size_t numEvents);
 
 public:
 	InputEventCircularReader(size_t numEvents);
@@ -42,6 +51,9 @@ public:
 	ssize_t fill(int fd);
 	ssize_t readEvent(input_event const** events);
 	void next();
+	void setCapacity(size_t numEvents);
+
+	static size_t capacityFor(int64_t delay_ns, int64_t latency_ns);
 };
 
 /*****************************************************************************/
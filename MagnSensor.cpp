@@ -43,36 +43,59 @@
 
 /*****************************************************************************/
 
-sensors_vec_t  MagnSensor::dataBuffer;
-int MagnSensor::freq = 0;
-int MagnSensor::count_call_ecompass = 0;
-int MagnSensor::mEnabled = 0;
-int64_t MagnSensor::delayms = 0;
-int MagnSensor::current_fullscale = 0;
-#if (SENSORS_ACCELEROMETER_ENABLE == 1)
-AccelSensor* MagnSensor::acc = NULL;
-#endif
-int64_t MagnSensor::setDelayBuffer[numSensors] = {0};
-int64_t MagnSensor::writeDelayBuffer[numSensors] = {0};
-int MagnSensor::DecimationBuffer[numSensors] = {0};
-int MagnSensor::DecimationCount[numSensors] = {0};
-pthread_mutex_t MagnSensor::dataMutex;
+MagnSensor* MagnSensor::single = NULL;
+
+/*
+ * Every logical sensor built on the magnetometer shares the same
+ * instance, so the input device is opened and decoded only once.
+ */
+MagnSensor* MagnSensor::getInstance()
+{
+	if (!single)
+		single = new MagnSensor();
+	else
+		single->get();
+
+	return single;
+}
 
 MagnSensor::MagnSensor()
+#if (MAGN_IIO_ENABLE == 1)
+	: SensorBase(NULL, NULL),
+	mInputReader(6),
+	mHasPendingEvent(false),
+	mIIOReader(MAGN_IIO_CHANNEL)
+#else
 	: SensorBase(NULL, SENSOR_DATANAME_MAGNETIC_FIELD),
 	mInputReader(6),
 	mHasPendingEvent(false)
+#endif
 {
-	int err;
+	mEnabled = 0;
+	delayms = 0;
+	current_fullscale = 0;
+	count_call_ecompass = 0;
+	freq = 0;
+	memset(setDelayBuffer, 0, sizeof(setDelayBuffer));
+	memset(writeDelayBuffer, 0, sizeof(writeDelayBuffer));
+
+	mTransformValid = false;
+
+#if (MAGN_IIO_ENABLE == 1)
+	data_fd = openIIO(SENSOR_IIO_MAGNETIC_FIELD);
+	if ((data_fd >= 0) && (mIIOReader.setup(sysfs_device_path) < 0)) {
+		close(data_fd);
+		data_fd = -1;
+	}
+#endif
 
-	pthread_mutex_init(&dataMutex, NULL);
+	int err;
 
 #if SENSOR_GEOMAG_ENABLE == 1
 	refFreq = (MAGN_MAX_ODR < GEOMAG_FREQUENCY) ? MAGN_MAX_ODR : GEOMAG_FREQUENCY;
 #endif
 
 	memset(mPendingEvent, 0, sizeof(mPendingEvent));
-	memset(DecimationCount, 0, sizeof(DecimationCount));
 
 	mPendingEvent[MagneticField].version = sizeof(sensors_event_t);
 	mPendingEvent[MagneticField].sensor = ID_MAGNETIC_FIELD;
@@ -129,8 +152,11 @@ MagnSensor::MagnSensor()
 
 	memset(data_raw, 0, sizeof(data_raw));
 
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	acc = NULL;
+#endif
 #if (SENSOR_GEOMAG_ENABLE == 1)
-	acc = new AccelSensor();
+	acc = AccelSensor::getInstance();
 #endif
 }
 
@@ -139,10 +165,12 @@ MagnSensor::~MagnSensor() {
 		enable(SENSORS_MAGNETIC_FIELD_HANDLE, 0, 0);
 		mEnabled = 0;
 	}
-	pthread_mutex_destroy(&dataMutex);
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	acc->~AccelSensor();
+	if (acc)
+		acc->put();
 #endif
+	if (single == this)
+		single = NULL;
 }
 
 #if !defined(NOT_SET_MAG_INITIAL_STATE)
@@ -165,7 +193,6 @@ int MagnSensor::setInitialState()
 	}
 
 	setFullScale(SENSORS_MAGNETIC_FIELD_HANDLE, MAGN_DEFAULT_FULLSCALE);
-	memset(DecimationCount, 0, sizeof(DecimationCount));
 
 	return 0;
 }
@@ -377,6 +404,15 @@ int MagnSensor::setDelay(int32_t handle, int64_t delay_ns)
 	return err;
 }
 
+int MagnSensor::setLatency(int64_t latency_ns)
+{
+	SensorBase::setLatency(latency_ns);
+	mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+				MSEC_TO_NSEC(delayms), report_latency));
+
+	return 0;
+}
+
 int MagnSensor::writeMinDelay(void)
 {
 	int err = 0;
@@ -424,24 +460,21 @@ int MagnSensor::writeMinDelay(void)
 		if(err >= 0) {
 			err = 0;
 			delayms = Min_delay_ms;
+			mInputReader.setCapacity(InputEventCircularReader::capacityFor(
+					MSEC_TO_NSEC(delayms), report_latency));
+			mTimestampEstimator.setPeriod(MSEC_TO_NSEC(delayms));
 			freq = 1000.0f / Min_delay_ms;
 #if (MAG_CALIBRATION_ENABLE == 1)
 			count_call_ecompass = freq / CALIBRATION_FREQUENCY;
 #endif
-			memset(DecimationCount, 0, sizeof(DecimationCount));
 		}
 	}
 
 	// Decimation Definition
 	for(kk = 0; kk < numSensors; kk++)
 	{
-		if (kk == MagneticField || kk == UncalibMagneticField)
-			continue;
-
-		if (delayms)
-			DecimationBuffer[kk] = writeDelayBuffer[kk]/delayms;
-		else
-			DecimationBuffer[kk] = 0;
+		Decimation[kk].setPeriod(delayms ?
+				MSEC_TO_NSEC(writeDelayBuffer[kk]) : 0);
 	}
 
 #if (DEBUG_POLL_RATE == 1)
@@ -451,10 +484,10 @@ int MagnSensor::writeMinDelay(void)
 				writeDelayBuffer[6], writeDelayBuffer[7]);
 	STLOGD("MagSensor::Min_delay_ms = %lld, delayms = %lld, mEnabled = %d",
 				Min_delay_ms, delayms, mEnabled);
-	STLOGD("MagSensor::DecimationBuffer = %d, %d, %d, %d, %d, %d, %d, %d",
-				DecimationBuffer[0], DecimationBuffer[1], DecimationBuffer[2],
-				DecimationBuffer[3], DecimationBuffer[4], DecimationBuffer[5],
-				DecimationBuffer[6], DecimationBuffer[7]);
+	STLOGD("MagSensor::Decimation periods = %lld, %lld, %lld, %lld, %lld, %lld, %lld, %lld",
+				Decimation[0].getPeriod(), Decimation[1].getPeriod(), Decimation[2].getPeriod(),
+				Decimation[3].getPeriod(), Decimation[4].getPeriod(), Decimation[5].getPeriod(),
+				Decimation[6].getPeriod(), Decimation[7].getPeriod());
 	STLOGD("MagSensor::count_call_ecompass = %d", count_call_ecompass);
 #endif
 
@@ -489,226 +522,281 @@ int MagnSensor::setFullScale(int32_t __attribute__((unused))handle, int value)
 	return err;
 }
 
-int MagnSensor::readEvents(sensors_event_t *data, int count)
+/*
+ * Fold conversion factor and axis matrix into mTransform, once: hard
+ * and soft iron calibration is applied later by the MagCal library.
+ */
+void MagnSensor::updateTransform()
 {
-	int err;
-	float MagOffset[3];
-
-	if (count < 1)
-		return -EINVAL;
+#if (MAGN_IIO_ENABLE == 1)
+	const float iio_scale = mIIOReader.getScale() * IIO_GAUSS_TO_UT;
+	const float scale[3] = { iio_scale, iio_scale, iio_scale };
+#else
+	static const float scale[3] = { CONVERT_M_X, CONVERT_M_Y, CONVERT_M_Z };
+#endif
+	static const float bias[3] = { 0.0f, 0.0f, 0.0f };
+	static const float sens[3] = { 1.0f, 1.0f, 1.0f };
 
-	if (mHasPendingEvent) {
-		mHasPendingEvent = false;
-	}
+	if (mTransformValid)
+		return;
 
-	ssize_t n = mInputReader.fill(data_fd);
-	if (n < 0)
-		return n;
+	mTransform.set(scale, matrix_mag, bias, sens);
+	mTransformValid = true;
+}
 
+/*
+ * Run scale and axis remap over the decoded frames at once, then
+ * dispatch them one by one while there is room in data.
+ */
+int MagnSensor::processSamples(sensors_event_t *data, int count)
+{
 	int numEventReceived = 0;
-	input_event const* event;
-
-#if FETCH_FULL_EVENT_BEFORE_RETURN
-	again:
-#endif
+	float MagOffset[3];
+	int err, i;
 
-	while (count && mInputReader.readEvent(&event)) {
+	updateTransform();
+	mSamples.transform(mTransform);
 
-		if (event->type == EVENT_TYPE_MAG) {
-			float value = (float) event->value;
+	for (i = mSamples.first; (count > 0) && (i < mSamples.count); i++) {
+		data_rot[0] = mSamples.x[i];
+		data_rot[1] = mSamples.y[i];
+		data_rot[2] = mSamples.z[i];
+		timestamp = mSamples.timestamp[i];
 
-			if (event->code == EVENT_TYPE_MAG_X) {
-				data_raw[0] = value * CONVERT_M_X;
-			} else if (event->code == EVENT_TYPE_MAG_Y) {
-				data_raw[1] = value * CONVERT_M_Y;
-			} else if (event->code == EVENT_TYPE_MAG_Z) {
-				data_raw[2] = value * CONVERT_M_Z;
-			}
-#if defined(MAG_EVENT_HAS_TIMESTAMP)
-			else if (event->code == EVENT_TYPE_TIME_MSB) {
-				timestamp = ((int64_t)(event->value)) << 32;
-			}
-			else if (event->code == EVENT_TYPE_TIME_LSB) {
-				timestamp |= (uint32_t)(event->value);
-			}
-#endif
-			else {
-				STLOGE("MagnSensor: unknown event code (type = %d, code = %d)", event->type, event->code);
-			}
-		} else if (event->type == EV_SYN) {
-			data_rot[0] =	data_raw[0] * matrix_mag[0][0] +
-					data_raw[1] * matrix_mag[1][0] +
-					data_raw[2] * matrix_mag[2][0];
-			data_rot[1] = 	data_raw[0] * matrix_mag[0][1] +
-					data_raw[1] * matrix_mag[1][1] +
-					data_raw[2] * matrix_mag[2][1];
-			data_rot[2] = 	data_raw[0] * matrix_mag[0][2] +
-					data_raw[1] * matrix_mag[1][2] +
-					data_raw[2] * matrix_mag[2][2];
-
-#if !defined(MAG_EVENT_HAS_TIMESTAMP)
-			timestamp = timevalToNano(event->time);
-#endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			AccelSensor::getBufferData(&mSensorsBufferedVectors[ID_ACCELEROMETER]);
+		if (acc)
+			acc->getHistory()->readAt(
+					&mSensorsBufferedVectors[ID_ACCELEROMETER],
+					timestamp);
 #endif /* SENSORS_ACCELEROMETER_ENABLE */
 #if (MAG_CALIBRATION_ENABLE == 1)
-			magCalibIn.timestamp = timestamp;
-			magCalibIn.mag_raw[0] = data_rot[0];
-			magCalibIn.mag_raw[1] = data_rot[1];
-			magCalibIn.mag_raw[2] = data_rot[2];
+		magCalibIn.timestamp = timestamp;
+		magCalibIn.mag_raw[0] = data_rot[0];
+		magCalibIn.mag_raw[1] = data_rot[1];
+		magCalibIn.mag_raw[2] = data_rot[2];
 
-			ST_MagCalibration_API_Run(&magCalibOut, &magCalibIn);
+		ST_MagCalibration_API_Run(&magCalibOut, &magCalibIn);
 #if (DEBUG_CALIBRATION == 1)
-				STLOGD("Calibration MagData [uT] -> raw_x:%f raw_y:%f raw_z:%f",
-					data_rot[0], data_rot[1], data_rot[2]);
-				STLOGD("Calibration MagData [uT] -> uncal_x:%f uncal_y:%f uncal_z:%f",
-					magCalibOut.mag_cal[0], magCalibOut.mag_cal[1],
-					magCalibOut.mag_cal[2]);
+			STLOGD("Calibration MagData [uT] -> raw_x:%f raw_y:%f raw_z:%f",
+				data_rot[0], data_rot[1], data_rot[2]);
+			STLOGD("Calibration MagData [uT] -> uncal_x:%f uncal_y:%f uncal_z:%f",
+				magCalibOut.mag_cal[0], magCalibOut.mag_cal[1],
+				magCalibOut.mag_cal[2]);
 #endif /* DEBUG_CALIBRATION */
 #endif /* MAG_CALIBRATION_ENABLE */
-			if (mEnabled & ((1 << MagneticField) |
-						(1 << UncalibMagneticField) |
-						(1 << GeoMagRotVect_Magnetic) |
-						(1 << Orientation) |
-						(1 << Linear_Accel) |
-						(1 << Gravity_Accel) |
-						(1 << iNemoMagnetic) |
-						(1 << VirtualGyro))) {
-				/**
-				 * Get and apply Hard Iron calibration to raw mag data
-				 */
+		if (mEnabled & ((1 << MagneticField) |
+					(1 << UncalibMagneticField) |
+					(1 << GeoMagRotVect_Magnetic) |
+					(1 << Orientation) |
+					(1 << Linear_Accel) |
+					(1 << Gravity_Accel) |
+					(1 << iNemoMagnetic) |
+					(1 << VirtualGyro))) {
+			/**
+			 * Get and apply Hard Iron calibration to raw mag data
+			 */
 #if (MAG_CALIBRATION_ENABLE == 1)
-				data_calibrated.v[0] = magCalibOut.mag_cal[0];
-				data_calibrated.v[1] = magCalibOut.mag_cal[1];
-				data_calibrated.v[2] = magCalibOut.mag_cal[2];
-				data_calibrated.status = magCalibOut.accuracy;
-				MagOffset[0] = magCalibOut.offset[0];
-				MagOffset[1] = magCalibOut.offset[1];
-				MagOffset[2] = magCalibOut.offset[2];
+			data_calibrated.v[0] = magCalibOut.mag_cal[0];
+			data_calibrated.v[1] = magCalibOut.mag_cal[1];
+			data_calibrated.v[2] = magCalibOut.mag_cal[2];
+			data_calibrated.status = magCalibOut.accuracy;
+			MagOffset[0] = magCalibOut.offset[0];
+			MagOffset[1] = magCalibOut.offset[1];
+			MagOffset[2] = magCalibOut.offset[2];
 
 #if (DEBUG_MAGNETOMETER == 1)
-				STLOGD("MagnSensor::MagCalibData: %f, %f, %f", data_calibrated.v[0], data_calibrated.v[1], data_calibrated.v[2]);
+			STLOGD("MagnSensor::MagCalibData: %f, %f, %f", data_calibrated.v[0], data_calibrated.v[1], data_calibrated.v[2]);
 #endif
 #else
-				/**
-				 * No calibration is available!
-				 */
-				memcpy(data_calibrated.v, data_rot, sizeof(data_calibrated.v));
-				data_calibrated.status = SENSOR_STATUS_UNRELIABLE;
+			/**
+			 * No calibration is available!
+			 */
+			memcpy(data_calibrated.v, data_rot, sizeof(data_calibrated.v));
+			data_calibrated.status = SENSOR_STATUS_UNRELIABLE;
 #endif
 
 #if ((SENSORS_GEOMAG_ROTATION_VECTOR_ENABLE == 1) ||\
-	 (GEOMAG_COMPASS_ORIENTATION_ENABLE == 1) ||\
-	 (GEOMAG_LINEAR_ACCELERATION_ENABLE == 1) ||\
-	 (GEOMAG_GRAVITY_ENABLE == 1))
-				memcpy(sData.accel,
-				       mSensorsBufferedVectors[ID_ACCELEROMETER].v,
-							sizeof(sData.accel));
-				memcpy(sData.magn, data_calibrated.v,
-							sizeof(data_calibrated.v));
-				iNemoEngine_GeoMag_API_Run(MagnSensor::delayms, &sData);
-#endif
-				DecimationCount[MagneticField]++;
-				if((mEnabled & (1<<MagneticField)) && (DecimationCount[MagneticField] >= DecimationBuffer[MagneticField])) {
-					DecimationCount[MagneticField] = 0;
-					mPendingEvent[MagneticField].magnetic.status =
-							data_calibrated.status;
-					memcpy(mPendingEvent[MagneticField].data,
-							data_calibrated.v,
-							sizeof(data_calibrated.v));
-					mPendingEvent[MagneticField].timestamp = timestamp;
-					*data++ = mPendingEvent[MagneticField];
-					count--;
-					numEventReceived++;
-				}
+ (GEOMAG_COMPASS_ORIENTATION_ENABLE == 1) ||\
+ (GEOMAG_LINEAR_ACCELERATION_ENABLE == 1) ||\
+ (GEOMAG_GRAVITY_ENABLE == 1))
+			memcpy(sData.accel,
+			       mSensorsBufferedVectors[ID_ACCELEROMETER].v,
+						sizeof(sData.accel));
+			memcpy(sData.magn, data_calibrated.v,
+						sizeof(data_calibrated.v));
+			iNemoEngine_GeoMag_API_Run(MagnSensor::delayms, &sData);
+#endif
+			if ((mEnabled & (1<<MagneticField)) &&
+			    Decimation[MagneticField].sample(timestamp,
+					data_calibrated.v, mPendingEvent[MagneticField].data)) {
+				mPendingEvent[MagneticField].magnetic.status =
+						data_calibrated.status;
+				mPendingEvent[MagneticField].timestamp = timestamp;
+				*data++ = mPendingEvent[MagneticField];
+				count--;
+				numEventReceived++;
+			}
 #if (SENSORS_UNCALIB_MAGNETIC_FIELD_ENABLE == 1)
-				DecimationCount[UncalibMagneticField]++;
-				if((mEnabled & (1<<UncalibMagneticField)) && (DecimationCount[UncalibMagneticField] >= DecimationBuffer[UncalibMagneticField])) {
-					DecimationCount[UncalibMagneticField] = 0;
-					mPendingEvent[UncalibMagneticField].magnetic.status = 
-							data_calibrated.status;
-					memcpy(mPendingEvent[UncalibMagneticField].uncalibrated_magnetic.uncalib,
-							data_rot, sizeof(data_rot));
-					memcpy(mPendingEvent[UncalibMagneticField].uncalibrated_magnetic.bias,
-							MagOffset, sizeof(MagOffset));
-					mPendingEvent[UncalibMagneticField].timestamp = timestamp;
-					*data++ = mPendingEvent[UncalibMagneticField];
-					count--;
-					numEventReceived++;
-				}
+			if ((mEnabled & (1<<UncalibMagneticField)) &&
+			    Decimation[UncalibMagneticField].sample(timestamp, data_rot,
+					mPendingEvent[UncalibMagneticField].uncalibrated_magnetic.uncalib)) {
+				mPendingEvent[UncalibMagneticField].magnetic.status = 
+						data_calibrated.status;
+				memcpy(mPendingEvent[UncalibMagneticField].uncalibrated_magnetic.bias,
+						MagOffset, sizeof(MagOffset));
+				mPendingEvent[UncalibMagneticField].timestamp = timestamp;
+				*data++ = mPendingEvent[UncalibMagneticField];
+				count--;
+				numEventReceived++;
+			}
 #endif
 #if (SENSORS_GEOMAG_ROTATION_VECTOR_ENABLE == 1)
-				DecimationCount[GeoMagRotVect_Magnetic]++;
-				if((mEnabled & (1<<GeoMagRotVect_Magnetic)) && (DecimationCount[GeoMagRotVect_Magnetic] >= DecimationBuffer[GeoMagRotVect_Magnetic])) {
-					DecimationCount[GeoMagRotVect_Magnetic] = 0;
-
-					err = iNemoEngine_GeoMag_API_Get_Quaternion(mPendingEvent[GeoMagRotVect_Magnetic].data);
-					if (err == 0) {
-						mPendingEvent[GeoMagRotVect_Magnetic].magnetic.status =
-							data_calibrated.status;
-						mPendingEvent[GeoMagRotVect_Magnetic].data[4] = -1;
-						mPendingEvent[GeoMagRotVect_Magnetic].timestamp = timestamp;
-						*data++ = mPendingEvent[GeoMagRotVect_Magnetic];
-						count--;
-						numEventReceived++;
-					}
+			if ((mEnabled & (1<<GeoMagRotVect_Magnetic)) && Decimation[GeoMagRotVect_Magnetic].sample(timestamp)) {
+
+				err = iNemoEngine_GeoMag_API_Get_Quaternion(mPendingEvent[GeoMagRotVect_Magnetic].data);
+				if (err == 0) {
+					mPendingEvent[GeoMagRotVect_Magnetic].magnetic.status =
+						data_calibrated.status;
+					mPendingEvent[GeoMagRotVect_Magnetic].data[4] = -1;
+					mPendingEvent[GeoMagRotVect_Magnetic].timestamp = timestamp;
+					*data++ = mPendingEvent[GeoMagRotVect_Magnetic];
+					count--;
+					numEventReceived++;
 				}
+			}
 #endif
 #if ((GEOMAG_LINEAR_ACCELERATION_ENABLE == 1))
-				DecimationCount[Linear_Accel]++;
-				if((mEnabled & (1<<Linear_Accel)) && (DecimationCount[Linear_Accel] >= DecimationBuffer[Linear_Accel])) {
-					DecimationCount[Linear_Accel] = 0;
-					err = iNemoEngine_GeoMag_API_Get_LinAcc(mPendingEvent[Linear_Accel].data);
-					if (err == 0) {
-						mPendingEvent[Linear_Accel].timestamp = timestamp;
-						*data++ = mPendingEvent[Linear_Accel];
-						count--;
-						numEventReceived++;
-					}
+			if ((mEnabled & (1<<Linear_Accel)) && Decimation[Linear_Accel].sample(timestamp)) {
+				err = iNemoEngine_GeoMag_API_Get_LinAcc(mPendingEvent[Linear_Accel].data);
+				if (err == 0) {
+					mPendingEvent[Linear_Accel].timestamp = timestamp;
+					*data++ = mPendingEvent[Linear_Accel];
+					count--;
+					numEventReceived++;
 				}
+			}
 #endif
 #if ((GEOMAG_GRAVITY_ENABLE == 1))
-				DecimationCount[Gravity_Accel]++;
-				if((mEnabled & (1<<Gravity_Accel)) && (DecimationCount[Gravity_Accel] >= DecimationBuffer[Gravity_Accel])) {
-					DecimationCount[Gravity_Accel] = 0;
-					err = iNemoEngine_GeoMag_API_Get_Gravity(mPendingEvent[Gravity_Accel].data);
-					if (err == 0) {
-						mPendingEvent[Gravity_Accel].timestamp = timestamp;
-						*data++ = mPendingEvent[Gravity_Accel];
-						count--;
-						numEventReceived++;
-					}
+			if ((mEnabled & (1<<Gravity_Accel)) && Decimation[Gravity_Accel].sample(timestamp)) {
+				err = iNemoEngine_GeoMag_API_Get_Gravity(mPendingEvent[Gravity_Accel].data);
+				if (err == 0) {
+					mPendingEvent[Gravity_Accel].timestamp = timestamp;
+					*data++ = mPendingEvent[Gravity_Accel];
+					count--;
+					numEventReceived++;
 				}
+			}
 #endif
 #if (GEOMAG_COMPASS_ORIENTATION_ENABLE == 1)
-				DecimationCount[Orientation]++;
-				if((mEnabled & (1<<Orientation)) && (DecimationCount[Orientation] >= DecimationBuffer[Orientation])) {
-					DecimationCount[Orientation] = 0;
-					err = iNemoEngine_GeoMag_API_Get_Hpr(mPendingEvent[Orientation].data);
-					if (err == 0) {
-						mPendingEvent[Orientation].orientation.status =
-							data_calibrated.status;
-						mPendingEvent[Orientation].timestamp = timestamp;
-						*data++ = mPendingEvent[Orientation];
-						count--;
-						numEventReceived++;
-					}
+			if ((mEnabled & (1<<Orientation)) && Decimation[Orientation].sample(timestamp)) {
+				err = iNemoEngine_GeoMag_API_Get_Hpr(mPendingEvent[Orientation].data);
+				if (err == 0) {
+					mPendingEvent[Orientation].orientation.status =
+						data_calibrated.status;
+					mPendingEvent[Orientation].timestamp = timestamp;
+					*data++ = mPendingEvent[Orientation];
+					count--;
+					numEventReceived++;
 				}
+			}
 #endif
 #if (SENSOR_FUSION_ENABLE == 1) || \
     (SENSORS_VIRTUAL_GYROSCOPE_ENABLE == 1)
-				if(mEnabled & ((1<<iNemoMagnetic) |
-					       (1<<VirtualGyro)))
-					setBufferData(&data_calibrated);
+			if(mEnabled & ((1<<iNemoMagnetic) |
+				       (1<<VirtualGyro)))
+				setBufferData(&data_calibrated, timestamp);
 #endif
 #if DEBUG_MAGNETOMETER == 1
-				STLOGD("MagnSensor::readEvents (time = %lld),"
-						"count(%d), received(%d)",
-						mPendingEvent[MagneticField].timestamp,
-						count, numEventReceived);
+			STLOGD("MagnSensor::readEvents (time = %lld),"
+					"count(%d), received(%d)",
+					mPendingEvent[MagneticField].timestamp,
+					count, numEventReceived);
 #endif
+		}
+	}
+
+	mSamples.consume(i - mSamples.first);
+
+	/* Wake the drivers clocked by this one (fusion, virtual gyroscope) */
+	dataBuffer.notify();
+
+	return numEventReceived;
+}
+
+int MagnSensor::readEvents(sensors_event_t *data, int count)
+{
+	if (count < 1)
+		return -EINVAL;
+
+	if (mHasPendingEvent) {
+		mHasPendingEvent = false;
+	}
+
+#if (MAGN_IIO_ENABLE == 1)
+	/* Scans are decoded straight into mSamples, timestamps included */
+	ssize_t n = mIIOReader.fill(data_fd, &mSamples, count - mSamples.pending());
+	if (n < 0)
+		return n;
+
+	return processSamples(data, count);
+#else
+	ssize_t n = mInputReader.fill(data_fd);
+	if (n < 0)
+		return n;
+
+	int numEventReceived = 0;
+	input_event const* event;
+
+#if FETCH_FULL_EVENT_BEFORE_RETURN
+	again:
+#endif
+
+	while (count > 0) {
+		bool more = mInputReader.readEvent(&event);
+
+		/*
+		 * Frames are decoded into mSamples and processed as a block when
+		 * it is full, when the input is drained or before any other event.
+		 */
+		if (mSamples.pending() && (!more || mSamples.isFull() ||
+					(mSamples.pending() >= count) ||
+					((event->type != EVENT_TYPE_MAG) && (event->type != EV_SYN)))) {
+			int nb = processSamples(data, count);
+			data += nb;
+			count -= nb;
+			numEventReceived += nb;
+			continue;
+		}
+
+		if (!more)
+			break;
+
+		if (event->type == EVENT_TYPE_MAG) {
+			float value = (float) event->value;
+
+			if (event->code == EVENT_TYPE_MAG_X) {
+				data_raw[0] = value;
+			} else if (event->code == EVENT_TYPE_MAG_Y) {
+				data_raw[1] = value;
+			} else if (event->code == EVENT_TYPE_MAG_Z) {
+				data_raw[2] = value;
+			}
+#if defined(MAG_EVENT_HAS_TIMESTAMP)
+			else if (event->code == EVENT_TYPE_TIME_MSB) {
+				timestamp = ((int64_t)(event->value)) << 32;
 			}
+			else if (event->code == EVENT_TYPE_TIME_LSB) {
+				timestamp |= (uint32_t)(event->value);
+			}
+#endif
+			else {
+				STLOGE("MagnSensor: unknown event code (type = %d, code = %d)", event->type, event->code);
+			}
+		} else if (event->type == EV_SYN) {
+#if !defined(MAG_EVENT_HAS_TIMESTAMP)
+			timestamp = mTimestampEstimator.estimate(timevalToNano(event->time));
+#endif
+			mSamples.push(data_raw, timestamp);
 		} else
 			STLOGE("MagnSensor: unknown event (type = %d, code = %d)",
 							event->type, event->code);
@@ -727,22 +815,17 @@ int MagnSensor::readEvents(sensors_event_t *data, int count)
 	}
 #endif
 	return numEventReceived;
+#endif
 }
 
-bool MagnSensor::setBufferData(sensors_vec_t *value)
+SensorHistory* MagnSensor::getHistory()
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(&dataBuffer, value, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
-
-	return true;
+	return &dataBuffer;
 }
 
-bool MagnSensor::getBufferData(sensors_vec_t *lastBufferedValues)
+bool MagnSensor::setBufferData(sensors_vec_t *value, int64_t timestamp)
 {
-	pthread_mutex_lock(&dataMutex);
-	memcpy(lastBufferedValues, &dataBuffer, sizeof(sensors_vec_t));
-	pthread_mutex_unlock(&dataMutex);
+	dataBuffer.write(value, timestamp);
 
 	return true;
 }
@@ -30,7 +30,14 @@
 #include "configuration.h"
 #include "sensors.h"
 #include "SensorBase.h"
+#include "Decimator.h"
+#include "SensorHistory.h"
 #include "InputEventReader.h"
+#include "SampleBlock.h"
+#include "TimestampEstimator.h"
+#if (MAGN_IIO_ENABLE == 1)
+#include "IIOBufferReader.h"
+#endif
 #include "AccelSensor.h"
 
 #if MAG_CALIBRATION_ENABLE == 1
@@ -63,9 +70,9 @@ class MagnSensor : public SensorBase
 		VirtualGyro,
 		numSensors
 	};
-	static int mEnabled;
-	static int64_t delayms;
-	static int current_fullscale;
+	int mEnabled;
+	int64_t delayms;
+	int current_fullscale;
 	InputEventCircularReader mInputReader;
 	sensors_event_t mPendingEvent[numSensors];
 	bool mHasPendingEvent;
@@ -80,42 +87,54 @@ class MagnSensor : public SensorBase
 #endif
 
 private:
-	static sensors_vec_t  dataBuffer;
-	static int64_t setDelayBuffer[numSensors];
-	static int64_t writeDelayBuffer[numSensors];
-	static int DecimationBuffer[numSensors];
-	static int DecimationCount[numSensors];
+	SensorHistory dataBuffer;
+	int64_t setDelayBuffer[numSensors];
+	int64_t writeDelayBuffer[numSensors];
+	Decimator Decimation[numSensors];
 	sensors_vec_t mSensorsBufferedVectors[3];
-	virtual bool setBufferData(sensors_vec_t *value);
+	virtual bool setBufferData(sensors_vec_t *value, int64_t timestamp);
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	static AccelSensor *acc;
+	AccelSensor *acc;
 #endif
 #if (SENSOR_GEOMAG_ENABLE == 1)
 	iNemoGeoMagSensorsData sData;
 #endif
 	float data_raw[3];
 	float data_rot[3];
+	SampleBlock mSamples;
+	SampleTransform mTransform;
+	bool mTransformValid;
+	TimestampEstimator mTimestampEstimator;
+#if (MAGN_IIO_ENABLE == 1)
+	IIOBufferReader mIIOReader;
+#endif
 	sensors_vec_t data_calibrated;
-	static pthread_mutex_t dataMutex;
 	int64_t timestamp;
 
+	static MagnSensor* single;
+
+	void updateTransform();
+	int processSamples(sensors_event_t *data, int count);
+
 public:
+	static MagnSensor* getInstance();
 	MagnSensor();
 	virtual ~MagnSensor();
 	virtual int readEvents(sensors_event_t* data, int count);
 	virtual bool hasPendingEvents() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
+	virtual int setLatency(int64_t latency_ns);
 	virtual int writeMinDelay(void);
-	static void getMagDelay(int64_t *Mag_Delay_ms);
+	void getMagDelay(int64_t *Mag_Delay_ms);
 	virtual int setFullScale(int32_t handle, int value);
 	virtual int enable(int32_t handle, int enabled, int type);
 	virtual int getWhatFromHandle(int32_t handle);
 	int64_t getDelayms() {
 		return delayms;
 	};
-	static bool getBufferData(sensors_vec_t *lastBufferedValues);
-	static int count_call_ecompass;
-	static int freq;
+	SensorHistory* getHistory();
+	int count_call_ecompass;
+	int freq;
 };
 
 #endif  /* ANDROID_MAGN_SENSOR_H */
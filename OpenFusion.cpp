@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#if (SENSORS_OPEN_FUSION_ENABLE == 1)
+
+#include <math.h>
+#include <string.h>
+
+extern "C"
+{
+	#include "OpenFusionAPI.h"
+};
+
+/*
+ * Mahony-type complementary filter. The attitude quaternion (device frame
+ * to East-North-Up) is integrated from the gyroscope and pulled towards
+ * the accelerometer (tilt) and, for the 9X filter, the magnetometer
+ * (heading only) by a proportional term. The integral term is the
+ * gyroscope bias estimate, shared by both filters.
+ *
+ * The kernel works on fixed size float arrays with no data dependent
+ * branches in the inner loops, so that the compiler can vectorize it.
+ */
+
+#define OF_GRAVITY			(9.80665f)
+#define OF_RAD2DEG			(57.29577951f)
+#define OF_KP				(0.5f)	/* proportional gain [1/s] */
+#define OF_KP_STARTUP			(5.0f)	/* fast convergence after (re)start */
+#define OF_STARTUP_TIME			(2.0f)	/* [s] */
+#define OF_KI				(0.05f)	/* bias learning gain [1/s^2] */
+#define OF_ACC_TOLERANCE		(0.15f)	/* accel trusted for |a| in g * (1 +/- tol) */
+#define OF_GBIAS_MAX_RATE		(0.35f)	/* bias learned below this rate [rad/s] */
+#define OF_GBIAS_MAX			(0.2f)	/* bias clamp [rad/s] */
+
+struct of_filter {
+	float q[4];		/* w, x, y, z */
+	float time;		/* time since (re)start [s] */
+	bool enabled;
+	bool aligned;
+};
+
+static struct {
+	struct of_filter f6;
+	struct of_filter f9;
+	float gbias[3];
+	float accel[3];
+	bool learn_gbias;
+} of;
+
+static inline float of_dot3(const float *a, const float *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void of_cross3(const float *a, const float *b, float *r)
+{
+	r[0] = a[1] * b[2] - a[2] * b[1];
+	r[1] = a[2] * b[0] - a[0] * b[2];
+	r[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static float of_normalize(float *v, int n)
+{
+	float norm = 0.0f;
+	int i;
+
+	for (i = 0; i < n; i++)
+		norm += v[i] * v[i];
+
+	norm = sqrtf(norm);
+	if (norm > 0.0f) {
+		float inv = 1.0f / norm;
+
+		for (i = 0; i < n; i++)
+			v[i] *= inv;
+	}
+
+	return norm;
+}
+
+/* Rotation matrix device to world, m[i] is world axis i in device frame */
+static void of_rotmat(const float *q, float m[3][3])
+{
+	float ww = q[0] * q[0], xx = q[1] * q[1];
+	float yy = q[2] * q[2], zz = q[3] * q[3];
+	float wx = q[0] * q[1], wy = q[0] * q[2], wz = q[0] * q[3];
+	float xy = q[1] * q[2], xz = q[1] * q[3], yz = q[2] * q[3];
+
+	m[0][0] = ww + xx - yy - zz;
+	m[0][1] = 2.0f * (xy - wz);
+	m[0][2] = 2.0f * (xz + wy);
+	m[1][0] = 2.0f * (xy + wz);
+	m[1][1] = ww - xx + yy - zz;
+	m[1][2] = 2.0f * (yz - wx);
+	m[2][0] = 2.0f * (xz - wy);
+	m[2][1] = 2.0f * (yz + wx);
+	m[2][2] = ww - xx - yy + zz;
+}
+
+/*
+ * Initial attitude from the gravity direction and a reference vector
+ * pointing roughly north (magnetic field, or the device y axis when the
+ * heading is arbitrary).
+ */
+static void of_align(struct of_filter *f, const float *up, const float *ref)
+{
+	float m[3][3], t;
+	float *q = f->q;
+
+	of_cross3(ref, up, m[0]);
+	if (of_normalize(m[0], 3) < 1e-3f) {
+		const float x[3] = { 1.0f, 0.0f, 0.0f };
+
+		of_cross3(x, up, m[0]);
+		of_normalize(m[0], 3);
+	}
+	of_cross3(up, m[0], m[1]);
+	memcpy(m[2], up, sizeof(m[2]));
+
+	t = m[0][0] + m[1][1] + m[2][2];
+	if (t > 0.0f) {
+		float s = 0.5f / sqrtf(t + 1.0f);
+
+		q[0] = 0.25f / s;
+		q[1] = (m[2][1] - m[1][2]) * s;
+		q[2] = (m[0][2] - m[2][0]) * s;
+		q[3] = (m[1][0] - m[0][1]) * s;
+	} else if ((m[0][0] > m[1][1]) && (m[0][0] > m[2][2])) {
+		float s = 2.0f * sqrtf(1.0f + m[0][0] - m[1][1] - m[2][2]);
+
+		q[0] = (m[2][1] - m[1][2]) / s;
+		q[1] = 0.25f * s;
+		q[2] = (m[0][1] + m[1][0]) / s;
+		q[3] = (m[0][2] + m[2][0]) / s;
+	} else if (m[1][1] > m[2][2]) {
+		float s = 2.0f * sqrtf(1.0f + m[1][1] - m[0][0] - m[2][2]);
+
+		q[0] = (m[0][2] - m[2][0]) / s;
+		q[1] = (m[0][1] + m[1][0]) / s;
+		q[2] = 0.25f * s;
+		q[3] = (m[1][2] + m[2][1]) / s;
+	} else {
+		float s = 2.0f * sqrtf(1.0f + m[2][2] - m[0][0] - m[1][1]);
+
+		q[0] = (m[1][0] - m[0][1]) / s;
+		q[1] = (m[0][2] + m[2][0]) / s;
+		q[2] = (m[1][2] + m[2][1]) / s;
+		q[3] = 0.25f * s;
+	}
+
+	of_normalize(q, 4);
+	f->time = 0.0f;
+	f->aligned = true;
+}
+
+/*
+ * One filter step. up is the normalized accelerometer (NULL when not
+ * trusted), north the normalized magnetometer (NULL for the 6X filter);
+ * the bias estimate is updated only when learn is set.
+ */
+static void of_update(struct of_filter *f, const float *gyro, const float *up,
+			const float *north, float dt, bool learn)
+{
+	float m[3][3], e[3] = { 0.0f, 0.0f, 0.0f }, w[3], W[4][4], dq[4];
+	float kp = (f->time < OF_STARTUP_TIME) ? OF_KP_STARTUP : OF_KP;
+	float *q = f->q;
+	int i, k;
+
+	of_rotmat(q, m);
+
+	if (up) {
+		/* tilt error: measured vs estimated gravity direction */
+		of_cross3(up, m[2], e);
+
+		if (north) {
+			float h[3], ref[3], em[3], d;
+
+			/* reference field: horizontal part on the north axis */
+			for (i = 0; i < 3; i++)
+				h[i] = of_dot3(m[i], north);
+
+			d = sqrtf(h[0] * h[0] + h[1] * h[1]);
+			for (i = 0; i < 3; i++)
+				ref[i] = d * m[1][i] + h[2] * m[2][i];
+
+			/* heading error only, the tilt comes from the accelerometer */
+			of_cross3(north, ref, em);
+			d = of_dot3(em, m[2]);
+			for (i = 0; i < 3; i++)
+				e[i] += d * m[2][i];
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+		w[i] = gyro[i] - of.gbias[i];
+
+	if (learn && up && (of_dot3(w, w) < OF_GBIAS_MAX_RATE * OF_GBIAS_MAX_RATE)) {
+		for (i = 0; i < 3; i++) {
+			of.gbias[i] -= OF_KI * e[i] * dt;
+			if (of.gbias[i] > OF_GBIAS_MAX)
+				of.gbias[i] = OF_GBIAS_MAX;
+			else if (of.gbias[i] < -OF_GBIAS_MAX)
+				of.gbias[i] = -OF_GBIAS_MAX;
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+		w[i] = (w[i] + kp * e[i]) * 0.5f * dt;
+
+	/* q += q * (0, w) */
+	W[0][0] = 0.0f;  W[0][1] = -w[0]; W[0][2] = -w[1]; W[0][3] = -w[2];
+	W[1][0] = w[0];  W[1][1] = 0.0f;  W[1][2] = w[2];  W[1][3] = -w[1];
+	W[2][0] = w[1];  W[2][1] = -w[2]; W[2][2] = 0.0f;  W[2][3] = w[0];
+	W[3][0] = w[2];  W[3][1] = w[1];  W[3][2] = -w[0]; W[3][3] = 0.0f;
+
+	for (i = 0; i < 4; i++) {
+		dq[i] = 0.0f;
+		for (k = 0; k < 4; k++)
+			dq[i] += W[i][k] * q[k];
+	}
+	for (i = 0; i < 4; i++)
+		q[i] += dq[i];
+
+	of_normalize(q, 4);
+	f->time += dt;
+}
+
+/* Android rotation vector layout: x, y, z, w with w >= 0 */
+static int of_get_quaternion(const struct of_filter *f, float *quaternion)
+{
+	float sign;
+
+	if (!f->enabled || !f->aligned)
+		return -1;
+
+	sign = (f->q[0] < 0.0f) ? -1.0f : 1.0f;
+	quaternion[0] = sign * f->q[1];
+	quaternion[1] = sign * f->q[2];
+	quaternion[2] = sign * f->q[3];
+	quaternion[3] = sign * f->q[0];
+
+	return 0;
+}
+
+/* Gravity direction in device frame, from the 6X filter if running */
+static int of_get_up(float *up)
+{
+	const struct of_filter *f = &of.f6;
+	float m[3][3];
+
+	if (!f->enabled || !f->aligned)
+		f = &of.f9;
+	if (!f->enabled || !f->aligned)
+		return -1;
+
+	of_rotmat(f->q, m);
+	memcpy(up, m[2], sizeof(m[2]));
+
+	return 0;
+}
+
+int iNemoEngine_API_Initialization(iNemoInitData *init_data,
+				   iNemoDebugInitData *debug_data)
+{
+	(void)debug_data;
+
+	if (!init_data)
+		return -1;
+
+	memset(&of, 0, sizeof(of));
+	of.f6.q[0] = 1.0f;
+	of.f9.q[0] = 1.0f;
+	of.learn_gbias = (init_data->GbiasLearningMode != 0);
+
+	return 0;
+}
+
+void iNemoEngine_API_enable6X(bool enable)
+{
+	if (enable && !of.f6.enabled)
+		of.f6.aligned = false;
+
+	of.f6.enabled = enable;
+}
+
+void iNemoEngine_API_enable9X(bool enable)
+{
+	if (enable && !of.f9.enabled)
+		of.f9.aligned = false;
+
+	of.f9.enabled = enable;
+}
+
+void iNemoEngine_API_Run(int64_t timeElapsed, iNemoSensorsData *data)
+{
+	const float y[3] = { 0.0f, 1.0f, 0.0f };
+	float up[3], north[3], norm;
+	float dt = (float)timeElapsed * 1e-9f;
+	const float *acc_ok, *mag_ok;
+
+	memcpy(of.accel, data->accel, sizeof(of.accel));
+	memcpy(up, data->accel, sizeof(up));
+	memcpy(north, data->magn, sizeof(north));
+
+	norm = of_normalize(up, 3);
+	acc_ok = (fabsf(norm - OF_GRAVITY) < OF_ACC_TOLERANCE * OF_GRAVITY) ? up : NULL;
+	mag_ok = (of_normalize(north, 3) > 0.0f) ? north : NULL;
+
+	if (of.f9.enabled) {
+		if (!of.f9.aligned) {
+			if (acc_ok && mag_ok)
+				of_align(&of.f9, up, north);
+		} else if (dt > 0.0f) {
+			of_update(&of.f9, data->gyro, acc_ok, mag_ok, dt,
+				  of.learn_gbias);
+		}
+	}
+
+	if (of.f6.enabled) {
+		if (!of.f6.aligned) {
+			if (acc_ok)
+				of_align(&of.f6, up, y);
+		} else if (dt > 0.0f) {
+			of_update(&of.f6, data->gyro, acc_ok, NULL, dt,
+				  of.learn_gbias && !of.f9.enabled);
+		}
+	}
+}
+
+int iNemoEngine_API_Get_Euler_Angles(float *hpr)
+{
+	float m[3][3];
+
+	if (!of.f9.enabled || !of.f9.aligned)
+		return -1;
+
+	of_rotmat(of.f9.q, m);
+
+	/* azimuth [0, 360), pitch [-180, 180], roll [-90, 90] */
+	hpr[0] = atan2f(m[0][1], m[1][1]) * OF_RAD2DEG;
+	if (hpr[0] < 0.0f)
+		hpr[0] += 360.0f;
+	hpr[1] = atan2f(-m[2][1], m[2][2]) * OF_RAD2DEG;
+	hpr[2] = asinf(fmaxf(-1.0f, fminf(1.0f, m[2][0]))) * OF_RAD2DEG;
+
+	return 0;
+}
+
+int iNemoEngine_API_Get_Gravity(float *gravity)
+{
+	float up[3];
+	int i;
+
+	if (of_get_up(up) < 0)
+		return -1;
+
+	for (i = 0; i < 3; i++)
+		gravity[i] = OF_GRAVITY * up[i];
+
+	return 0;
+}
+
+int iNemoEngine_API_Get_Linear_Acceleration(float *linacc)
+{
+	float up[3];
+	int i;
+
+	if (of_get_up(up) < 0)
+		return -1;
+
+	for (i = 0; i < 3; i++)
+		linacc[i] = of.accel[i] - OF_GRAVITY * up[i];
+
+	return 0;
+}
+
+int iNemoEngine_API_Get_Quaternion(float *quaternion)
+{
+	return of_get_quaternion(&of.f9, quaternion);
+}
+
+int iNemoEngine_API_Get_6X_Quaternion(float *quaternion)
+{
+	return of_get_quaternion(&of.f6, quaternion);
+}
+
+int iNemoEngine_API_Get_Gbias(float *gbias)
+{
+	memcpy(gbias, of.gbias, sizeof(of.gbias));
+
+	return 0;
+}
+
+#endif /* SENSORS_OPEN_FUSION_ENABLE */
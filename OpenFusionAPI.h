@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_OPEN_FUSION_API_H
+#define ANDROID_OPEN_FUSION_API_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Built-in replacement of the iNemoEngineProAPI library: same entry points
+ * and data types, implemented by a complementary quaternion filter with
+ * gyroscope bias estimation (see OpenFusion.cpp).
+ */
+
+typedef struct {
+	int GbiasLearningMode;		/* 0: bias learning disabled */
+	int ATime;
+	int MTime;
+	int PTime;
+	int FrTime;
+	char *gbias_file;
+	float LocalEarthMagField;	/* [uT] */
+	float Gbias_threshold_magn;
+	float Gbias_threshold_accel;
+	float Gbias_threshold_gyro;
+} iNemoInitData;
+
+typedef struct {
+	int accel_flag;
+	int magn_flag;
+	int gyro_flag;
+} iNemoDebugInitData;
+
+typedef struct {
+	float accel[3];			/* [m/s^2] */
+	float magn[3];			/* [uT] */
+	float gyro[3];			/* [rad/sec] */
+} iNemoSensorsData;
+
+int iNemoEngine_API_Initialization(iNemoInitData *init_data, iNemoDebugInitData *debug_data);
+void iNemoEngine_API_enable6X(bool enable);
+void iNemoEngine_API_enable9X(bool enable);
+void iNemoEngine_API_Run(int64_t timeElapsed, iNemoSensorsData *data);
+int iNemoEngine_API_Get_Euler_Angles(float *hpr);
+int iNemoEngine_API_Get_Gravity(float *gravity);
+int iNemoEngine_API_Get_Linear_Acceleration(float *linacc);
+int iNemoEngine_API_Get_Quaternion(float *quaternion);
+int iNemoEngine_API_Get_6X_Quaternion(float *quaternion);
+int iNemoEngine_API_Get_Gbias(float *gbias);
+
+#endif /* ANDROID_OPEN_FUSION_API_H */
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SampleBlock.h"
+
+/*****************************************************************************/
+
+/*
+ * out[j] = (sum_i(raw[i] * scale[i] * matrix[i][j]) - bias[j]) * sens[j]
+ */
+void SampleTransform::set(const float scale[3], const short matrix[3][3],
+				const float bias[3], const float sens[3])
+{
+	for (int j = 0; j < 3; j++) {
+		for (int i = 0; i < 3; i++)
+			a[j][i] = scale[i] * matrix[i][j] * sens[j];
+
+		a[j][3] = -bias[j] * sens[j];
+	}
+
+	permutation = true;
+	for (int j = 0; j < 3; j++) {
+		int nonzero = 0;
+
+		for (int i = 0; i < 3; i++) {
+			if (matrix[i][j] != 0) {
+				perm[j] = i;
+				nonzero++;
+			}
+		}
+
+		if (nonzero != 1)
+			permutation = false;
+	}
+}
+
+SampleBlock::SampleBlock()
+	: first(0),
+	mapped(0),
+	count(0)
+{
+}
+
+void SampleBlock::push(const float raw[3], int64_t ts)
+{
+	x[count] = raw[0];
+	y[count] = raw[1];
+	z[count] = raw[2];
+	timestamp[count] = ts;
+	count++;
+}
+
+/*
+ * Scale the raw frames decoded since the last call and rotate them into
+ * the device frame, out[j] = sum(raw[i] * scale[i] * matrix[i][j]), then
+ * apply (out - bias) * sens. Everything is folded into nine coefficients
+ * and three offsets hoisted out of the loop, so that each iteration only
+ * touches the x/y/z arrays.
+ */
+void SampleBlock::transform(const SampleTransform& t)
+{
+	float * __restrict__ px = x;
+	float * __restrict__ py = y;
+	float * __restrict__ pz = z;
+	const float a00 = t.a[0][0], a01 = t.a[0][1], a02 = t.a[0][2], a03 = t.a[0][3];
+	const float a10 = t.a[1][0], a11 = t.a[1][1], a12 = t.a[1][2], a13 = t.a[1][3];
+	const float a20 = t.a[2][0], a21 = t.a[2][1], a22 = t.a[2][2], a23 = t.a[2][3];
+
+	/* Sources alias the outputs here: no restrict */
+	if (t.permutation) {
+		const float *axis[3] = { x, y, z };
+		const float *s0 = axis[t.perm[0]];
+		const float *s1 = axis[t.perm[1]];
+		const float *s2 = axis[t.perm[2]];
+		const float k0 = t.a[0][t.perm[0]];
+		const float k1 = t.a[1][t.perm[1]];
+		const float k2 = t.a[2][t.perm[2]];
+
+		for (int i = mapped; i < count; i++) {
+			const float r0 = s0[i], r1 = s1[i], r2 = s2[i];
+
+			x[i] = r0 * k0 + a03;
+			y[i] = r1 * k1 + a13;
+			z[i] = r2 * k2 + a23;
+		}
+
+		mapped = count;
+		return;
+	}
+
+	for (int i = mapped; i < count; i++) {
+		const float rx = px[i], ry = py[i], rz = pz[i];
+
+		px[i] = rx * a00 + ry * a01 + rz * a02 + a03;
+		py[i] = rx * a10 + ry * a11 + rz * a12 + a13;
+		pz[i] = rx * a20 + ry * a21 + rz * a22 + a23;
+	}
+
+	mapped = count;
+}
+
+/* Release processed frames, the block restarts empty once all are done */
+void SampleBlock::consume(int frames)
+{
+	first += frames;
+	if (first >= count) {
+		first = 0;
+		mapped = 0;
+		count = 0;
+	}
+}
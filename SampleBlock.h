@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SAMPLE_BLOCK_H
+#define ANDROID_SAMPLE_BLOCK_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Frames decoded before the block is processed */
+#define SAMPLE_BLOCK_SIZE			(64)
+
+/*****************************************************************************/
+
+/**
+ * Conversion factor, axis matrix, bias and sensitivity folded into one
+ * 3x4 affine transform: out[j] = a[j][0..2] . raw + a[j][3]. Drivers keep
+ * it cached and rebuild it only when the calibration changes.
+ */
+class SampleTransform {
+public:
+	float a[3][4];
+
+	/*
+	 * Mounting matrices are almost always signed permutations: then
+	 * out[j] = raw[perm[j]] * a[j][perm[j]] + a[j][3] and the transform
+	 * runs as a swap/negate kernel instead of the full matrix product.
+	 */
+	bool permutation;
+	int perm[3];
+
+	void set(const float scale[3], const short matrix[3][3],
+				const float bias[3], const float sens[3]);
+};
+
+/**
+ * 3-axis frames decoded from input events, stored as separate x/y/z
+ * arrays so that scaling, axis remap and calibration run as one loop
+ * over the whole block that the compiler vectorizes (NEON/SSE).
+ */
+class SampleBlock {
+public:
+	float x[SAMPLE_BLOCK_SIZE] __attribute__((aligned(16)));
+	float y[SAMPLE_BLOCK_SIZE] __attribute__((aligned(16)));
+	float z[SAMPLE_BLOCK_SIZE] __attribute__((aligned(16)));
+	int64_t timestamp[SAMPLE_BLOCK_SIZE];
+
+	int first;	/* next frame to process */
+	int mapped;	/* frames already transformed */
+	int count;	/* frames decoded */
+
+	SampleBlock();
+
+	bool isFull() const { return count == SAMPLE_BLOCK_SIZE; }
+	int pending() const { return count - first; }
+
+	void push(const float raw[3], int64_t ts);
+	void transform(const SampleTransform& t);
+	void consume(int frames);
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_SAMPLE_BLOCK_H */
@@ -22,6 +22,7 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <stdlib.h>
 #include <sys/select.h>
 #include <cutils/log.h>
 #include <linux/input.h>
@@ -29,19 +30,33 @@
 #include <linux/ioctl.h>
 #include <linux/rtc.h>
 #include <utils/Atomic.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "SensorBase.h"
 #include "configuration.h"
 #include "sensors.h"
+#include "IIOBufferReader.h"
 
 /*****************************************************************************/
 
-SensorBase::SensorBase(const char* dev_name, const char* data_name)
+/*
+ * instance selects among identical devices (e.g. the IMUs of a redundant
+ * board): the Nth one with the name, in enumeration order.
+ */
+SensorBase::SensorBase(const char* dev_name, const char* data_name, int instance)
 	: dev_name(dev_name), data_name(data_name),
-	dev_fd(-1), data_fd(-1)
+	dev_fd(-1), data_fd(-1),
+	report_latency(0),
+	iio_backend(false),
+	mRefCount(1),
+	mSysfsAttrCount(0),
+	mConfigDepth(0)
 {
+	pthread_mutex_init(&mSysfsLock, NULL);
+
 	if(data_name)
-		data_fd = openInput(data_name);
+		data_fd = openInput(data_name, instance);
 }
 
 SensorBase::~SensorBase()
@@ -51,6 +66,22 @@ SensorBase::~SensorBase()
 
 	if (dev_fd >= 0)
 		close(dev_fd);
+
+	for (int i = 0; i < mSysfsAttrCount; i++)
+		close(mSysfsAttr[i].fd);
+
+	pthread_mutex_destroy(&mSysfsLock);
+}
+
+void SensorBase::get()
+{
+	mRefCount++;
+}
+
+void SensorBase::put()
+{
+	if (--mRefCount == 0)
+		delete this;
 }
 
 int SensorBase::open_device()
@@ -73,7 +104,8 @@ int SensorBase::close_device()
 
 int SensorBase::getFd() const
 {
-	if (!data_name)
+	/* IIO drivers have no input device name but read scans from data_fd */
+	if (!data_name && !iio_backend)
 		return dev_fd;
 
 	return data_fd;
@@ -85,72 +117,357 @@ int SensorBase::setDelay(int32_t  __attribute__((unused)) handle,
 	return 0;
 }
 
+/* Longest report latency requested on any sensor of this driver */
+int SensorBase::setLatency(int64_t latency_ns)
+{
+	report_latency = latency_ns;
+
+	return 0;
+}
+
 bool SensorBase::hasPendingEvents() const
 {
 	return false;
 }
 
-int SensorBase::openInput(const char* inputDeviceName)
+int SensorBase::openInput(const char* inputDeviceName, int instance)
 {
 	int fd = -1;
-	fd = getSysfsDevicePath(sysfs_device_path, inputDeviceName);
+	fd = getSysfsDevicePath(sysfs_device_path, inputDeviceName, instance);
 	sysfs_device_path_len = strlen(sysfs_device_path);
+
+#if defined(EVIOCSCLOCKID)
+	/*
+	 * evdev stamps events with CLOCK_REALTIME by default, which jumps on
+	 * time updates: use the sensors time base, or at least CLOCK_MONOTONIC
+	 * on kernels not supporting it.
+	 */
+	if (fd >= 0) {
+		int clock_id = SENSORS_CLOCK_ID;
+
+		if (ioctl(fd, EVIOCSCLOCKID, &clock_id) < 0) {
+			clock_id = CLOCK_MONOTONIC;
+			if (ioctl(fd, EVIOCSCLOCKID, &clock_id) < 0)
+				STLOGE("%s: failed to set the event clock", inputDeviceName);
+		}
+	}
+#endif
+
 	return fd;
 }
 
+#define IIO_DEVICES_MAX				(16)
 
-int SensorBase::getSysfsDevicePath(char* sysfs_path ,const char* inputDeviceName)
+static bool iioDeviceMatches(const char* device, const char* iioDeviceName)
+{
+	char path[PATH_MAX], name[80];
+	int fd, len;
+
+	snprintf(path, sizeof(path), "%s%s/name", IIO_DEVICES_DIR, device);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	len = read(fd, name, sizeof(name) - 1);
+	close(fd);
+	if (len <= 0)
+		return false;
+
+	name[len] = '\0';
+	if (name[len - 1] == '\n')
+		name[len - 1] = '\0';
+
+	return !strcmp(name, iioDeviceName);
+}
+
+static int compareDeviceNumbers(const void* a, const void* b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * Open the character device of the IIO device named iioDeviceName, the
+ * instance-th one by device number if there are several. The sysfs
+ * attributes are then relative to /sys/bus/iio/devices/iio:deviceN/.
+ */
+int SensorBase::openIIO(const char* iioDeviceName, int instance)
+{
+	int devices[IIO_DEVICES_MAX];
+	int count = 0, fd = -1;
+	char path[PATH_MAX];
+	struct dirent *de;
+	DIR *dir;
+
+	dir = opendir(IIO_DEVICES_DIR);
+	if (dir == NULL) {
+		STLOGE("couldn't open %s", IIO_DEVICES_DIR);
+		return -1;
+	}
+
+	while ((de = readdir(dir)) && (count < IIO_DEVICES_MAX)) {
+		if (strncmp(de->d_name, "iio:device", 10))
+			continue;
+
+		if (iioDeviceMatches(de->d_name, iioDeviceName))
+			devices[count++] = atoi(de->d_name + 10);
+	}
+	closedir(dir);
+
+	qsort(devices, count, sizeof(int), compareDeviceNumbers);
+
+	if (instance < count) {
+		snprintf(path, sizeof(path), "/dev/iio:device%d", devices[instance]);
+		fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		snprintf(sysfs_device_path, sizeof(sysfs_device_path), "%siio:device%d/",
+						IIO_DEVICES_DIR, devices[instance]);
+		sysfs_device_path_len = strlen(sysfs_device_path);
+		iio_backend = true;
+	}
+
+	STLOGE_IF(fd < 0, "couldn't open IIO device '%s'", iioDeviceName);
+	return fd;
+}
+
+
+/*
+ * /dev/input is enumerated once, at the first lookup, and the name of
+ * every event device is cached for all the drivers.
+ */
+#define INPUT_DEVICES_MAX			(64)
+
+static struct input_device_info {
+	char name[80];
+	char node[32];
+} inputDevices[INPUT_DEVICES_MAX];
+static int inputDevicesCount = -1;
+static pthread_mutex_t inputDevicesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int compareInputDevices(const void* a, const void* b)
+{
+	const char *na = ((const struct input_device_info *)a)->node;
+	const char *nb = ((const struct input_device_info *)b)->node;
+
+	/* eventN nodes: shorter names have a lower N */
+	if (strlen(na) != strlen(nb))
+		return (int)strlen(na) - (int)strlen(nb);
+
+	return strcmp(na, nb);
+}
+
+static void scanInputDevices(const char *dirname)
 {
-	int fd = -1;
-	const char *dirname = "/dev/input";
 	char devname[PATH_MAX];
 	char *filename;
 	DIR *dir;
 	struct dirent *de;
 
-	sysfs_path[0] ='\0';
-	dir = opendir(dirname);
+	inputDevicesCount = 0;
 
+	dir = opendir(dirname);
 	if(dir == NULL)
-		return -1;
+		return;
 
 	strcpy(devname, dirname);
 	filename = devname + strlen(devname);
 	*filename++ = '/';
 
-	while((de = readdir(dir))) {
+	while((de = readdir(dir)) && (inputDevicesCount < INPUT_DEVICES_MAX)) {
+		struct input_device_info *info = &inputDevices[inputDevicesCount];
+		int fd;
+
 		if(de->d_name[0] == '.' && (de->d_name[1] == '\0' || (de->d_name[1] == '.' && de->d_name[2] == '\0')))
 			continue;
 
+		if (strlen(de->d_name) >= sizeof(info->node))
+			continue;
+
 		strcpy(filename, de->d_name);
 		fd = open(devname, O_RDONLY);
-		if (fd >= 0) {
-			char name[80];
-			if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1)
-				name[0] = '\0';
-
-			if (!strcmp(name, inputDeviceName)) {
-				strcpy(sysfs_path,"/sys/class/input/");
-				strcat(sysfs_path,filename);
-				strcat(sysfs_path,"/device/");
-
-				break;
-			} else {
-				close(fd);
-				fd = -1;
-			}
+		if (fd < 0)
+			continue;
+
+		if (ioctl(fd, EVIOCGNAME(sizeof(info->name) - 1), info->name) >= 1) {
+			info->name[sizeof(info->name) - 1] = '\0';
+			strcpy(info->node, de->d_name);
+			inputDevicesCount++;
 		}
+		close(fd);
 	}
 	closedir(dir);
+
+	/* Identical devices are told apart by their enumeration order */
+	qsort(inputDevices, inputDevicesCount, sizeof(inputDevices[0]),
+							compareInputDevices);
+}
+
+int SensorBase::getSysfsDevicePath(char* sysfs_path ,const char* inputDeviceName,
+								int instance)
+{
+	int fd = -1;
+	const char *dirname = "/dev/input";
+	char devname[PATH_MAX];
+
+	sysfs_path[0] ='\0';
+
+	pthread_mutex_lock(&inputDevicesLock);
+	if (inputDevicesCount < 0)
+		scanInputDevices(dirname);
+
+	for (int i = 0; i < inputDevicesCount; i++) {
+		if (strcmp(inputDevices[i].name, inputDeviceName) || (instance-- > 0))
+			continue;
+
+		sprintf(devname, "%s/%s", dirname, inputDevices[i].node);
+		fd = open(devname, O_RDONLY);
+		if (fd >= 0) {
+			strcpy(sysfs_path,"/sys/class/input/");
+			strcat(sysfs_path,inputDevices[i].node);
+			strcat(sysfs_path,"/device/");
+		}
+		break;
+	}
+	pthread_mutex_unlock(&inputDevicesLock);
+
 	STLOGE_IF(fd < 0, "couldn't find sysfs path for device '%s' ", inputDeviceName);
 	return fd;
 }
 
+/*
+ * Write value to the attr sysfs file, called with mSysfsLock held. A value
+ * equal to the last one successfully written is not written again, so
+ * repeated reconfiguration does not restart the device.
+ */
+int SensorBase::flushSysfsAttr(struct sysfs_attr *attr, const char *value)
+{
+	int len = strlen(value);
+	int err;
+
+	if (!strcmp(attr->value, value)) {
+		STLOGD("SensorBase: %s already set to %s", attr->name, value);
+		return len;
+	}
+
+	err = pwrite(attr->fd, value, len, 0);
+	if (err == len) {
+		strcpy(attr->value, value);
+	} else {
+		attr->value[0] = '\0';
+		STLOGE("SensorBase: failed to write %s to %s", value, attr->name);
+	}
+
+	return err;
+}
+
+/*
+ * Write value to the attribute currently selected in sysfs_device_path.
+ * Attribute fds are opened once and kept for the driver lifetime. Inside
+ * a beginConfig()/commitConfig() transaction the value is only recorded;
+ * enable tells commitConfig() to order the attribute around the others.
+ * Return the number of bytes written (or deferred), negative on error.
+ */
+int SensorBase::writeSysfsAttr(const char *value, bool enable)
+{
+	const char *name = &sysfs_device_path[sysfs_device_path_len];
+	struct sysfs_attr *attr = NULL;
+	int len = strlen(value);
+	int i, fd, err;
+
+	pthread_mutex_lock(&mSysfsLock);
+
+	for (i = 0; i < mSysfsAttrCount; i++) {
+		if (!strcmp(mSysfsAttr[i].name, name)) {
+			attr = &mSysfsAttr[i];
+			break;
+		}
+	}
+
+	if (!attr) {
+		fd = open(sysfs_device_path, O_RDWR | O_CLOEXEC);
+		if (fd < 0) {
+			pthread_mutex_unlock(&mSysfsLock);
+			return -errno;
+		}
+
+		if ((mSysfsAttrCount == SYSFS_ATTR_CACHE_SIZE) ||
+				(strlen(name) >= SYSFS_ATTR_NAME_MAX)) {
+			/* Cache full, fall back to a one-shot write */
+			err = write(fd, value, len);
+			close(fd);
+			pthread_mutex_unlock(&mSysfsLock);
+			return err;
+		}
+
+		attr = &mSysfsAttr[mSysfsAttrCount++];
+		strcpy(attr->name, name);
+		attr->value[0] = '\0';
+		attr->dirty = false;
+		attr->enable = enable;
+		attr->fd = fd;
+	}
+
+	if (mConfigDepth) {
+		strcpy(attr->pending, value);
+		attr->dirty = true;
+		err = len;
+	} else {
+		err = flushSysfsAttr(attr, value);
+	}
+
+	pthread_mutex_unlock(&mSysfsLock);
+
+	return err;
+}
+
+void SensorBase::beginConfig()
+{
+	pthread_mutex_lock(&mSysfsLock);
+	mConfigDepth++;
+	pthread_mutex_unlock(&mSysfsLock);
+}
+
+/*
+ * Apply the writes collected since the outermost beginConfig(), only the
+ * last value of each attribute. Devices being disabled are turned off
+ * first, then full-scale, ODR and other settings are programmed, and
+ * devices are enabled last so that the chip starts once, already
+ * configured.
+ */
+int SensorBase::commitConfig()
+{
+	struct sysfs_attr *attr;
+	int i, pass, err = 0;
+
+	pthread_mutex_lock(&mSysfsLock);
+
+	if (!mConfigDepth || --mConfigDepth) {
+		pthread_mutex_unlock(&mSysfsLock);
+		return 0;
+	}
+
+	for (pass = 0; pass < 3; pass++) {
+		for (i = 0; i < mSysfsAttrCount; i++) {
+			attr = &mSysfsAttr[i];
+			if (!attr->dirty || (attr->enable == (pass == 1)))
+				continue;
+
+			if ((pass == 0) && strcmp(attr->pending, "0"))
+				continue;
+
+			attr->dirty = false;
+			if (flushSysfsAttr(attr, attr->pending) < 0)
+				err = -1;
+		}
+	}
+
+	pthread_mutex_unlock(&mSysfsLock);
+
+	return err;
+}
+
 int SensorBase::writeFullScale(int32_t handle, int value)
 {
-	int fd;
 	int err;
-	char buf[6];
+	char buf[SYSFS_ATTR_VALUE_MAX];
 	const char *className;
 
 	switch(handle) {
@@ -177,11 +494,14 @@ int SensorBase::writeFullScale(int32_t handle, int value)
 			return -1;
 	}
 
+	/* IIO devices report their own scale, read with the scan layout */
+	if (iio_backend) {
+		STLOGD("%s Full-scale left to the IIO driver", className);
+		return 0;
+	}
 
-	fd = open(sysfs_device_path, O_RDWR);
-	sprintf(buf,"%d", value);
-	err = write(fd, buf, sizeof(buf));
-	close(fd);
+	snprintf(buf, sizeof(buf), "%d", value);
+	err = writeSysfsAttr(buf);
 
 	if(err >= 0) {
 		STLOGI("%s Set new full-scale to %d", className, value);
@@ -194,9 +514,8 @@ int SensorBase::writeFullScale(int32_t handle, int value)
 
 int SensorBase::writeEnable(int32_t handle, int enable)
 {
-	int fd;
 	int err;
-	char buf[6];
+	char buf[SYSFS_ATTR_VALUE_MAX];
 	const char *className;
 
 	switch(handle) {
@@ -273,10 +592,11 @@ int SensorBase::writeEnable(int32_t handle, int enable)
 			return -1;
 	}
 
-	fd = open(sysfs_device_path, O_RDWR);
-	sprintf(buf,"%d", enable);
-	err = write(fd, buf, sizeof(buf));
-	close(fd);
+	if (iio_backend)
+		strcpy(&sysfs_device_path[sysfs_device_path_len], IIO_BUFFER_ENABLE_FILE_NAME);
+
+	snprintf(buf, sizeof(buf), "%d", enable);
+	err = writeSysfsAttr(buf, true);
 
 	if(err > 0) {
 		STLOGI("%s Set enable to %d", className, enable);
@@ -289,9 +609,8 @@ int SensorBase::writeEnable(int32_t handle, int enable)
 
 int SensorBase::writeDelay(int32_t handle, int64_t delay_ms)
 {
-	int fd;
 	int err;
-	char buf[8];
+	char buf[SYSFS_ATTR_VALUE_MAX];
 	const char *className;
 
 	STLOGD( "SensorBase: setDelay handle = %d", handle);
@@ -341,10 +660,15 @@ int SensorBase::writeDelay(int32_t handle, int64_t delay_ms)
 			return -1;
 	}
 
-	fd = open(sysfs_device_path, O_RDWR);
-	sprintf(buf,"%lld", delay_ms);
-	err = write(fd, buf, sizeof(buf));
-	close(fd);
+	/* IIO devices take the output data rate in Hz */
+	if (iio_backend) {
+		sysfs_device_path[sysfs_device_path_len] = '\0';
+		IIOBufferReader::frequencyFor(sysfs_device_path, delay_ms, buf, sizeof(buf));
+		strcpy(&sysfs_device_path[sysfs_device_path_len], IIO_SAMPLING_FREQ_FILE_NAME);
+	} else
+		snprintf(buf, sizeof(buf), "%lld", delay_ms);
+
+	err = writeSysfsAttr(buf);
 
 	if(err > 0) {
 		STLOGI("%s Set delay to %lld [ms]", className, delay_ms);
@@ -357,9 +681,8 @@ int SensorBase::writeDelay(int32_t handle, int64_t delay_ms)
 
 int SensorBase::writeSysfsCommand(int32_t handle, const char *sysfsFilename, const char *dataFormat, int64_t param)
 {
-	int fd;
 	int err;
-	char buf[8];
+	char buf[SYSFS_ATTR_VALUE_MAX];
 	const char *className;
 
 	char formatstring1[50] = "%s Set %s to ";
@@ -377,10 +700,8 @@ int SensorBase::writeSysfsCommand(int32_t handle, const char *sysfsFilename, con
 			return -1;
 	}
 
-	fd = open(sysfs_device_path, O_RDWR);
-	sprintf(buf, dataFormat, param);
-	err = write(fd, buf, sizeof(buf));
-	close(fd);
+	snprintf(buf, sizeof(buf), dataFormat, param);
+	err = writeSysfsAttr(buf);
 
 
 	strcat(formatstring1, dataFormat);
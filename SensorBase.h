@@ -23,6 +23,7 @@
 #include <errno.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <pthread.h>
 
 #define DELAY_OFF		(-1000000)
 #define MSEC_TO_SEC(x)		((x) / 1000)
@@ -30,6 +31,11 @@
 #define MSEC_TO_NSEC(x)		((x) * 1000000)
 #define SEC_TO_MSEC(x)		((x) * 1000)
 #define SEC_TO_NSEC(x)		(MSEC_TO_NSEC(SEC_TO_MSEC(x)))
+
+/* Sysfs attributes kept open per driver, see writeSysfsAttr() */
+#define SYSFS_ATTR_CACHE_SIZE	(8)
+#define SYSFS_ATTR_NAME_MAX	(48)
+#define SYSFS_ATTR_VALUE_MAX	(24)
 /*****************************************************************************/
 
 struct sensors_event_t;
@@ -43,8 +49,11 @@ protected:
 	int sysfs_device_path_len;
 	int dev_fd;
 	int data_fd;
+	int64_t report_latency;
+	bool iio_backend;
 
-	int openInput(const char* inputDeviceName);
+	int openInput(const char* inputDeviceName, int instance = 0);
+	int openIIO(const char* iioDeviceName, int instance = 0);
 
 
 	static int64_t timevalToNano(timeval const& t) {
@@ -53,22 +62,50 @@ protected:
 
 	int open_device();
 	int close_device();
-	int getSysfsDevicePath(char* sysfs_path, const char* inputDeviceName);
+	int getSysfsDevicePath(char* sysfs_path, const char* inputDeviceName,
+							int instance = 0);
+	int writeSysfsAttr(const char *value, bool enable = false);
+
+private:
+	int mRefCount;
+
+	struct sysfs_attr {
+		char name[SYSFS_ATTR_NAME_MAX];
+		char value[SYSFS_ATTR_VALUE_MAX];
+		char pending[SYSFS_ATTR_VALUE_MAX];
+		bool dirty;
+		bool enable;
+		int fd;
+	} mSysfsAttr[SYSFS_ATTR_CACHE_SIZE];
+	int mSysfsAttrCount;
+	int mConfigDepth;
+	pthread_mutex_t mSysfsLock;
+
+	int flushSysfsAttr(struct sysfs_attr *attr, const char *value);
 
 public:
-	SensorBase(const char* dev_name, const char* data_name);
+	SensorBase(const char* dev_name, const char* data_name, int instance = 0);
 	virtual ~SensorBase();
 
 	virtual int readEvents(sensors_event_t* data, int count) = 0;
 	virtual bool hasPendingEvents() const;
 	virtual int getFd() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
+	virtual int setLatency(int64_t latency_ns);
 	virtual int enable(int32_t handle, int enabled, int type) = 0;
 	virtual int writeFullScale(int32_t handle, int value);
 	virtual int writeEnable(int32_t handle, int enable);
 	virtual int writeDelay(int32_t handle, int64_t delay_ms);
 	virtual int writeSysfsCommand(int32_t handle, const char *sysfsFilename, const char *dataFormat, int64_t param);
 	virtual int getWhatFromHandle(int32_t handle) = 0;
+
+	/* Reconfiguration transaction: sysfs writes are held until commit */
+	void beginConfig();
+	int commitConfig();
+
+	/* Physical drivers are shared by every logical sensor using them */
+	void get();
+	void put();
 };
 
 /*****************************************************************************/
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+
+#include "SensorHistory.h"
+
+/*****************************************************************************/
+
+SensorHistory::SensorHistory()
+	: mSeq(0),
+	mHead(0),
+	mUnsignaled(false)
+{
+	int i;
+
+	memset(mRing, 0, sizeof(mRing));
+	pthread_mutex_init(&mListenersLock, NULL);
+	for (i = 0; i < SENSOR_HISTORY_MAX_LISTENERS; i++)
+		mListeners[i] = -1;
+}
+
+SensorHistory::~SensorHistory()
+{
+	pthread_mutex_destroy(&mListenersLock);
+}
+
+/*
+ * Odd sequence while a sample is being added, even once it is stable.
+ */
+void SensorHistory::write(const sensors_vec_t *value, int64_t timestamp)
+{
+	uint32_t seq = mSeq;
+	struct entry *e = &mRing[mHead & (SENSOR_HISTORY_SIZE - 1)];
+
+	mSeq = seq + 1;
+	__sync_synchronize();
+	e->timestamp = timestamp;
+	memcpy(&e->value, value, sizeof(e->value));
+	mHead++;
+	__sync_synchronize();
+	mSeq = seq + 2;
+	mUnsignaled = true;
+}
+
+void SensorHistory::read(sensors_vec_t *value) const
+{
+	uint32_t seq;
+
+	do {
+		seq = mSeq;
+		__sync_synchronize();
+		memcpy(value, &mRing[(mHead - 1) & (SENSOR_HISTORY_SIZE - 1)].value,
+		       sizeof(*value));
+		__sync_synchronize();
+	} while ((seq & 1) || (seq != mSeq));
+}
+
+/*
+ * Interpolate between the two samples around timestamp. Requests out of
+ * the history return the oldest or the newest sample, no extrapolation.
+ */
+void SensorHistory::readAt(sensors_vec_t *value, int64_t timestamp) const
+{
+	struct entry before, after;
+	uint32_t seq, head, n, i;
+
+	do {
+		seq = mSeq;
+		__sync_synchronize();
+		head = mHead;
+		n = (head < SENSOR_HISTORY_SIZE) ? head : SENSOR_HISTORY_SIZE;
+
+		after = mRing[(head - 1) & (SENSOR_HISTORY_SIZE - 1)];
+		before = after;
+		for (i = 2; i <= n; i++) {
+			before = mRing[(head - i) & (SENSOR_HISTORY_SIZE - 1)];
+			if (before.timestamp <= timestamp)
+				break;
+
+			after = before;
+		}
+		__sync_synchronize();
+	} while ((seq & 1) || (seq != mSeq));
+
+	if ((timestamp >= after.timestamp) || (before.timestamp >= after.timestamp) ||
+	    (timestamp <= before.timestamp)) {
+		*value = (timestamp >= after.timestamp) ? after.value : before.value;
+		return;
+	}
+
+	float k = (float)(timestamp - before.timestamp) /
+				(float)(after.timestamp - before.timestamp);
+
+	*value = (k < 0.5f) ? before.value : after.value;
+	for (i = 0; i < 3; i++)
+		value->v[i] = before.value.v[i] +
+				k * (after.value.v[i] - before.value.v[i]);
+}
+
+uint32_t SensorHistory::getHead() const
+{
+	return mHead;
+}
+
+/*
+ * Return the sample at *cursor and advance it. A reader lapped by the
+ * writer is moved to the oldest sample still in the ring.
+ */
+bool SensorHistory::readNext(uint32_t *cursor, sensors_vec_t *value,
+					int64_t *timestamp) const
+{
+	struct entry e;
+	uint32_t seq, head, pos;
+
+	do {
+		seq = mSeq;
+		__sync_synchronize();
+		head = mHead;
+		pos = *cursor;
+		if (pos == head)
+			return false;
+
+		if ((head - pos) > SENSOR_HISTORY_SIZE)
+			pos = head - SENSOR_HISTORY_SIZE;
+
+		e = mRing[pos & (SENSOR_HISTORY_SIZE - 1)];
+		__sync_synchronize();
+	} while ((seq & 1) || (seq != mSeq));
+
+	if (pos != *cursor)
+		ALOGD("SensorHistory: reader lapped, %u samples lost", pos - *cursor);
+
+	*value = e.value;
+	*timestamp = e.timestamp;
+	*cursor = pos + 1;
+
+	return true;
+}
+
+int SensorHistory::addListener(int fd)
+{
+	int i, err = -ENOSPC;
+
+	pthread_mutex_lock(&mListenersLock);
+	for (i = 0; i < SENSOR_HISTORY_MAX_LISTENERS; i++) {
+		if (mListeners[i] < 0) {
+			mListeners[i] = fd;
+			err = 0;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mListenersLock);
+
+	return err;
+}
+
+void SensorHistory::removeListener(int fd)
+{
+	int i;
+
+	pthread_mutex_lock(&mListenersLock);
+	for (i = 0; i < SENSOR_HISTORY_MAX_LISTENERS; i++) {
+		if (mListeners[i] == fd)
+			mListeners[i] = -1;
+	}
+	pthread_mutex_unlock(&mListenersLock);
+}
+
+/*
+ * Called by the writer once per processed block, not per sample.
+ */
+void SensorHistory::notify()
+{
+	uint64_t one = 1;
+	int i;
+
+	if (!mUnsignaled)
+		return;
+
+	mUnsignaled = false;
+
+	pthread_mutex_lock(&mListenersLock);
+	for (i = 0; i < SENSOR_HISTORY_MAX_LISTENERS; i++) {
+		if (mListeners[i] >= 0)
+			::write(mListeners[i], &one, sizeof(one));
+	}
+	pthread_mutex_unlock(&mListenersLock);
+}
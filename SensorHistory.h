@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_HISTORY_H
+#define ANDROID_SENSOR_HISTORY_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+
+/* Samples kept per sensor, must be a power of 2 */
+#define SENSOR_HISTORY_SIZE			(128)
+#define SENSOR_HISTORY_MAX_LISTENERS		(4)
+
+/*****************************************************************************/
+
+/**
+ * Last samples of a driver with their timestamps, published to other
+ * sensors through a sequence lock: the (single) writer never blocks,
+ * readers retry only if they raced with a write. readAt() returns the
+ * sample linearly interpolated at any timestamp, so that consumers
+ * running at a different ODR fuse time-aligned data.
+ *
+ * Drivers that are clocked by another sensor (fusion, virtual gyroscope)
+ * register an eventfd with addListener(): it is signaled by notify() once
+ * per published block and the samples are then walked with readNext().
+ */
+class SensorHistory {
+	struct entry {
+		int64_t timestamp;
+		sensors_vec_t value;
+	};
+
+	volatile uint32_t mSeq;
+	uint32_t mHead;		/* samples written so far */
+	bool mUnsignaled;	/* samples written since the last notify() */
+	struct entry mRing[SENSOR_HISTORY_SIZE];
+
+	pthread_mutex_t mListenersLock;
+	int mListeners[SENSOR_HISTORY_MAX_LISTENERS];
+
+public:
+	SensorHistory();
+	~SensorHistory();
+
+	void write(const sensors_vec_t *value, int64_t timestamp);
+	void read(sensors_vec_t *value) const;
+	void readAt(sensors_vec_t *value, int64_t timestamp) const;
+
+	uint32_t getHead() const;
+	bool readNext(uint32_t *cursor, sensors_vec_t *value, int64_t *timestamp) const;
+
+	int addListener(int fd);
+	void removeListener(int fd);
+	void notify();
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_SENSOR_HISTORY_H */
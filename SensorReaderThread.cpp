@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2016 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <cutils/log.h>
+
+#include "SensorReaderThread.h"
+
+/*****************************************************************************/
+
+SensorReaderThread::SensorReaderThread(SensorBase* sensor, int priority, int cpu)
+	: mSensor(sensor),
+	mThreadStarted(false),
+	mRunning(true),
+	mPriority(priority),
+	mCpu(cpu),
+	mProducerWaiting(0),
+	mHead(0),
+	mTail(0),
+	mDrainRequest(0),
+	mDrainAck(0)
+{
+	mEventFd = eventfd(0, EFD_NONBLOCK);
+	mCtrlFd = eventfd(0, EFD_NONBLOCK);
+	if ((mEventFd < 0) || (mCtrlFd < 0)) {
+		STLOGE("SensorReaderThread: eventfd() failed (%s)", strerror(errno));
+		return;
+	}
+
+	if (pthread_create(&mThread, NULL, SensorReaderThread::threadLoop, this)) {
+		STLOGE("SensorReaderThread: failed to create reader thread");
+		return;
+	}
+
+	mThreadStarted = true;
+}
+
+SensorReaderThread::~SensorReaderThread()
+{
+	uint64_t stop = 1;
+
+	mRunning = false;
+	if (mThreadStarted) {
+		if (write(mCtrlFd, &stop, sizeof(stop)) < 0)
+			STLOGE("SensorReaderThread: failed to stop reader thread");
+
+		pthread_join(mThread, NULL);
+	}
+
+	if (mEventFd >= 0)
+		close(mEventFd);
+
+	if (mCtrlFd >= 0)
+		close(mCtrlFd);
+}
+
+int SensorReaderThread::getFd() const
+{
+	return mEventFd;
+}
+
+void* SensorReaderThread::threadLoop(void *arg)
+{
+	((SensorReaderThread *)arg)->setScheduling();
+	((SensorReaderThread *)arg)->run();
+
+	return NULL;
+}
+
+/*
+ * Applied from the thread itself; failures (e.g. missing CAP_SYS_NICE)
+ * leave the thread running with the default policy.
+ */
+void SensorReaderThread::setScheduling()
+{
+	if (mPriority > 0) {
+		struct sched_param param;
+
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = mPriority;
+		if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+			STLOGE("SensorReaderThread: failed to set SCHED_FIFO priority %d",
+			       mPriority);
+	}
+
+	if (mCpu >= 0) {
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(mCpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+			STLOGE("SensorReaderThread: failed to bind to cpu %d (%s)",
+			       mCpu, strerror(errno));
+	}
+}
+
+/*
+ * Producer side: wait for the driver fd and decode its events straight
+ * into the free part of the ring. The driver is also read when woken up
+ * with events already pending (e.g. the initial state queued on enable).
+ * When the ring is full only the control eventfd is polled, until the
+ * consumer frees some room. A drain request is acknowledged once the
+ * driver fd is found empty after the request was seen.
+ */
+void SensorReaderThread::run()
+{
+	struct pollfd fds[2];
+	uint64_t value;
+
+	fds[0].fd = mCtrlFd;
+	fds[0].events = POLLIN;
+	fds[1].fd = mSensor->getFd();
+	fds[1].events = POLLIN;
+
+	while (mRunning) {
+		uint32_t head = mHead;
+		uint32_t room = READER_RING_SIZE - (head - mTail);
+		uint32_t drain;
+
+		if (!room) {
+			mProducerWaiting = 1;
+			__sync_synchronize();
+			if (mHead - mTail == READER_RING_SIZE)
+				poll(fds, 1, -1);
+
+			mProducerWaiting = 0;
+			if (read(mCtrlFd, &value, sizeof(value)) < 0)
+				value = 0;
+
+			continue;
+		}
+
+		drain = mDrainRequest;
+		__sync_synchronize();
+
+		if (poll(fds, 2, (mSensor->hasPendingEvents() ||
+				  (drain != mDrainAck)) ? 0 : -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			STLOGE("SensorReaderThread: poll() failed (%s)", strerror(errno));
+			break;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			if (read(mCtrlFd, &value, sizeof(value)) < 0)
+				value = 0;
+		}
+
+		if (!mRunning)
+			continue;
+
+		if (!(fds[1].revents & POLLIN) && !mSensor->hasPendingEvents()) {
+			if (drain != mDrainAck) {
+				/* Events read before the request are in the ring */
+				__sync_synchronize();
+				mDrainAck = drain;
+				value = 1;
+				if (write(mEventFd, &value, sizeof(value)) < 0)
+					STLOGE("SensorReaderThread: failed to signal drain");
+			}
+
+			continue;
+		}
+
+		uint32_t idx = head & (READER_RING_SIZE - 1);
+		uint32_t len = READER_RING_SIZE - idx;
+		if (len > room)
+			len = room;
+
+		int nb = mSensor->readEvents(&mRing[idx], len);
+		if (nb <= 0)
+			continue;
+
+		/* Events must be visible before the new head */
+		__sync_synchronize();
+		mHead = head + nb;
+
+		value = 1;
+		if (write(mEventFd, &value, sizeof(value)) < 0)
+			STLOGE("SensorReaderThread: failed to signal events");
+	}
+}
+
+/*
+ * Have the thread read the driver even if its fd is not ready, called
+ * when the driver reports pending events.
+ */
+void SensorReaderThread::wake()
+{
+	uint64_t value = 1;
+
+	if (write(mCtrlFd, &value, sizeof(value)) < 0)
+		STLOGE("SensorReaderThread: failed to wake reader thread");
+}
+
+/*
+ * Ask the thread to move every event of the driver fd into the ring, e.g.
+ * on flush. Without thread the request is acknowledged right away.
+ */
+void SensorReaderThread::requestDrain()
+{
+	uint64_t value = 1;
+
+	mDrainRequest = mDrainRequest + 1;
+	if (!mThreadStarted) {
+		mDrainAck = mDrainRequest;
+		return;
+	}
+
+	__sync_synchronize();
+	if (write(mCtrlFd, &value, sizeof(value)) < 0)
+		STLOGE("SensorReaderThread: failed to request drain");
+}
+
+/*
+ * True once the last drain request has been acknowledged and the events
+ * pushed before it have been read.
+ */
+bool SensorReaderThread::isDrained() const
+{
+	if (mDrainAck != mDrainRequest)
+		return false;
+
+	__sync_synchronize();
+
+	return mHead == mTail;
+}
+
+/*
+ * Consumer side, called from pollEvents when getFd() is ready or when the
+ * previous call filled the caller buffer.
+ */
+int SensorReaderThread::readEvents(sensors_event_t* data, int count)
+{
+	uint64_t value;
+	uint32_t tail = mTail;
+	uint32_t nb;
+
+	if (count < 1)
+		return -EINVAL;
+
+	if (read(mEventFd, &value, sizeof(value)) < 0)
+		value = 0;
+
+	nb = mHead - tail;
+	__sync_synchronize();
+	if (nb > (uint32_t)count)
+		nb = count;
+
+	for (uint32_t i = 0; i < nb; i++)
+		data[i] = mRing[(tail + i) & (READER_RING_SIZE - 1)];
+
+	/* Slots are handed back to the producer only once copied */
+	__sync_synchronize();
+	mTail = tail + nb;
+	__sync_synchronize();
+
+	if (nb && mProducerWaiting) {
+		value = 1;
+		if (write(mCtrlFd, &value, sizeof(value)) < 0)
+			STLOGE("SensorReaderThread: failed to wake reader thread");
+	}
+
+	return nb;
+}
+
+#endif /* SENSORS_READER_THREADS_ENABLE || SENSORS_FUSION_THREAD_ENABLE */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "configuration.h"
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+
+#ifndef ANDROID_SENSOR_READER_THREAD_H
+#define ANDROID_SENSOR_READER_THREAD_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+
+/* Ring size in events, must be a power of 2 */
+#define READER_RING_SIZE			(256)
+
+/*****************************************************************************/
+
+/**
+ * Drain a driver on a dedicated thread. Decoded events are pushed into a
+ * single-producer/single-consumer lock-free ring and getFd() (an eventfd)
+ * becomes readable whenever the ring is not empty. The thread can run
+ * with SCHED_FIFO priority and be bound to a CPU (e.g. for the sensor
+ * fusion, so that its jitter does not depend on framework scheduling).
+ * requestDrain() has the thread read the driver until its fd is empty;
+ * isDrained() then tells when those events have all been consumed.
+ */
+class SensorReaderThread {
+	SensorBase* mSensor;
+	pthread_t mThread;
+	bool mThreadStarted;
+	volatile bool mRunning;
+	int mPriority;
+	int mCpu;
+
+	int mEventFd;		/* producer -> consumer: new events */
+	int mCtrlFd;		/* consumer -> producer: room available, stop */
+	volatile int mProducerWaiting;
+
+	sensors_event_t mRing[READER_RING_SIZE];
+	volatile uint32_t mHead;	/* written by the producer only */
+	volatile uint32_t mTail;	/* written by the consumer only */
+	volatile uint32_t mDrainRequest;	/* written by the consumer only */
+	volatile uint32_t mDrainAck;	/* written by the producer only */
+
+	static void* threadLoop(void *arg);
+	void setScheduling();
+	void run();
+
+public:
+	SensorReaderThread(SensorBase* sensor, int priority = 0, int cpu = -1);
+	~SensorReaderThread();
+
+	int getFd() const;
+	int readEvents(sensors_event_t* data, int count);
+	void wake();
+	void requestDrain();
+	bool isDrained() const;
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_SENSOR_READER_THREAD_H */
+
+#endif /* SENSORS_READER_THREADS_ENABLE || SENSORS_FUSION_THREAD_ENABLE */
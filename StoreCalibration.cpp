@@ -47,7 +47,7 @@ int StoreCalibration::cal_file = 0;
 int StoreCalibration::observer_fd = 0;
 int StoreCalibration::watch_fd = 0;
 calib_out_t StoreCalibration::calibration;
-bool StoreCalibration::is_changed = false;
+unsigned int StoreCalibration::serial = 0;
 
 static const struct sensor_spec_t {
 	uint8_t id;
@@ -169,7 +169,7 @@ void* StoreCalibration::checkChangesThread(void  __attribute__((unused))*arg)
 
 						pthread_mutex_lock(&lock);
 						memset(calibration, 0, sizeof(calibration));
-						is_changed = true;
+						serial++;
 						pthread_mutex_unlock(&lock);
 					} else {
 						ALOGI("Event not used %d", event->mask);
@@ -232,9 +232,10 @@ void StoreCalibration::readCalibrationFile()
 					calibration[sensor_spec[n].id][ZAxis]);
 			}
 		}
-		is_changed = true;
 	}
 
+	/* Values changed even if the file is gone: drivers rebuild their transform */
+	serial++;
 	pthread_mutex_unlock(&lock);
 	fin.close();
 }
@@ -249,13 +250,17 @@ float StoreCalibration::getCalibration(int sensorId, int axis)
 	}
 }
 
-bool StoreCalibration::isChanged()
+/*
+ * Each caller keeps its own copy of the update counter, so every driver
+ * sees every calibration update.
+ */
+bool StoreCalibration::isChanged(unsigned int *last)
 {
 	bool temp;
 
 	pthread_mutex_lock(&lock);
-	temp = is_changed;
-	is_changed = false;
+	temp = (*last != serial);
+	*last = serial;
 	pthread_mutex_unlock(&lock);
 
 	return temp;
@@ -68,7 +68,7 @@ private:
 	static int watch_fd;
 	static int cal_file;
 	pthread_t thread;
-	static bool is_changed;
+	static unsigned int serial;
 
 public:
 	enum {
@@ -96,7 +96,7 @@ public:
 		}
 	}
 	float getCalibration(int sensorId, int axis);
-	bool isChanged();
+	bool isChanged(unsigned int *last);
 };
 #endif /* STORE_CALIB_ENABLED */
 #endif /* _STORE_CALIBRATION_H */
\ No newline at end of file
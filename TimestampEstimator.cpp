@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TimestampEstimator.h"
+
+/*****************************************************************************/
+
+TimestampEstimator::TimestampEstimator()
+	: mLast(0),
+	mPeriod(0),
+	mRequestedPeriod(0)
+{
+	restart(0);
+}
+
+/*
+ * May be called from any thread when the ODR changes: the fit restarts
+ * on the next sample, on the thread reading the events.
+ */
+void TimestampEstimator::setPeriod(int64_t period_ns)
+{
+	if (period_ns > 0)
+		mRequestedPeriod = period_ns;
+}
+
+void TimestampEstimator::restart(int64_t timestamp)
+{
+	mS = mSn = mSt = mSnn = mSnt = 0.0;
+	mOrigin = timestamp;
+	mSamples = 0;
+}
+
+int64_t TimestampEstimator::estimate(int64_t timestamp)
+{
+	int64_t period = __sync_lock_test_and_set(&mRequestedPeriod, 0);
+	int64_t estimated = timestamp;
+	double dt, det;
+
+	if (period) {
+		mPeriod = period;
+		restart(timestamp);
+	}
+
+	dt = (double)(timestamp - mOrigin);
+	if ((dt <= 0.0) || (mPeriod && (dt > ESTIMATOR_RESYNC_PERIODS * mPeriod)))
+		restart(timestamp);
+
+	/* Move the origin to the new sample: (n, t) -> (n - 1, t - dt) */
+	dt = (double)(timestamp - mOrigin);
+	mSnt = mSnt - dt * mSn - mSt + dt * mS;
+	mSnn = mSnn - 2.0 * mSn + mS;
+	mSt = mSt - dt * mS;
+	mSn = mSn - mS;
+	mOrigin = timestamp;
+
+	mS = mS * ESTIMATOR_FORGETTING_FACTOR + 1.0;
+	mSn *= ESTIMATOR_FORGETTING_FACTOR;
+	mSt *= ESTIMATOR_FORGETTING_FACTOR;
+	mSnn *= ESTIMATOR_FORGETTING_FACTOR;
+	mSnt *= ESTIMATOR_FORGETTING_FACTOR;
+	mSamples++;
+
+	det = mS * mSnn - mSn * mSn;
+	if ((mSamples >= ESTIMATOR_MIN_SAMPLES) && (det > 0.0)) {
+		double slope = (mS * mSnt - mSn * mSt) / det;
+		double offset = (mSt - slope * mSn) / mS;
+
+		if (mPeriod && ((offset > ESTIMATOR_RESYNC_PERIODS * mPeriod) ||
+				(-offset > ESTIMATOR_RESYNC_PERIODS * mPeriod)))
+			restart(timestamp);
+		else
+			estimated = timestamp + (int64_t)offset;
+	}
+
+	if (estimated <= mLast)
+		estimated = mLast + 1;
+
+	mLast = estimated;
+
+	return estimated;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TIMESTAMP_ESTIMATOR_H
+#define ANDROID_TIMESTAMP_ESTIMATOR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Weight of the past samples in the fit, about 1 / (1 - x) samples long */
+#define ESTIMATOR_FORGETTING_FACTOR		(0.98)
+/* Samples needed before the fit replaces the measured timestamps */
+#define ESTIMATOR_MIN_SAMPLES			(8)
+/* Deviation from the fit, in periods, restarting the estimation */
+#define ESTIMATOR_RESYNC_PERIODS		(1.5)
+
+/*****************************************************************************/
+
+/**
+ * Rebuild sample timestamps from their delivery times: an exponentially
+ * weighted least-squares fit of time against sample index removes the
+ * IRQ and scheduling jitter while following the actual sensor clock.
+ * Output timestamps are strictly increasing. A lost sample, a new ODR or
+ * a drift larger than ESTIMATOR_RESYNC_PERIODS restarts the fit.
+ */
+class TimestampEstimator
+{
+	/* Sums over the samples, relative to the last one (index 0, mOrigin) */
+	double mS, mSn, mSt, mSnn, mSnt;
+	int64_t mOrigin;
+	int64_t mLast;
+	int64_t mPeriod;
+	int mSamples;
+	volatile int64_t mRequestedPeriod;
+
+	void restart(int64_t timestamp);
+
+public:
+	TimestampEstimator();
+
+	void setPeriod(int64_t period_ns);
+	int64_t estimate(int64_t timestamp);
+};
+
+/*****************************************************************************/
+
+#endif  /* ANDROID_TIMESTAMP_ESTIMATOR_H */
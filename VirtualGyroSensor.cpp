@@ -26,6 +26,7 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/eventfd.h>
 #include <sys/select.h>
 #include <cutils/log.h>
 #include <string.h>
@@ -36,24 +37,20 @@
 
 /****************************************************************************/
 
-sensors_vec_t  VirtualGyroSensor::dataBuffer;
-int VirtualGyroSensor::mEnabled = 0;
-int64_t VirtualGyroSensor::delayms = 0;
-int VirtualGyroSensor::startup_samples = 0;
-int VirtualGyroSensor::current_fullscale = 0;
-int VirtualGyroSensor::samples_to_discard = 0;
-int64_t VirtualGyroSensor::MagDelay_ms = MAG_DEFAULT_DELAY;
-int64_t VirtualGyroSensor::setDelayBuffer[numSensors] = {0};
-int VirtualGyroSensor::DecimationBuffer[numSensors] = {0};
-int VirtualGyroSensor::DecimationCount = 0;
-pthread_mutex_t VirtualGyroSensor::dataMutex;
 
 VirtualGyroSensor::VirtualGyroSensor()
-	: SensorBase(NULL, SENSOR_DATANAME_MAGNETIC_FIELD),
-	mInputReader(4),
-	mHasPendingEvent(false)
+	: SensorBase(NULL, NULL),
+	mHasPendingEvent(false),
+	mCursor(0),
+	pre_time(-1)
 {
-	pthread_mutex_init(&dataMutex, NULL);
+	mEnabled = 0;
+	delayms = 0;
+	current_fullscale = 0;
+	startup_samples = 0;
+	samples_to_discard = 0;
+	MagDelay_ms = MAG_DEFAULT_DELAY;
+	memset(setDelayBuffer, 0, sizeof(setDelayBuffer));
 
 	memset(mPendingEvent, 0, sizeof(mPendingEvent));
 	mPendingEvent[VirtualGyro].version = sizeof(sensors_event_t);
@@ -62,17 +59,14 @@ VirtualGyroSensor::VirtualGyroSensor()
 	mPendingEvent[VirtualGyro].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
 	memset(gyro, 0, sizeof(gyro));
 
-	if (data_fd) {
-		STLOGI("VirtualGyroSensor::VirtualGyroSensor main driver"
-			" device_sysfs_path:(%s)", sysfs_device_path);
-	} else {
-		STLOGE("VirtualGyroSensor::VirtualGyroSensor main driver"
-			" device_sysfs_path:(%s) not found", sysfs_device_path);
-	}
-
 	/* GeoMag library execution here only if GeoMag sensors are disabled */
-	mag = new MagnSensor();
-	acc = new AccelSensor();
+	mag = MagnSensor::getInstance();
+	acc = AccelSensor::getInstance();
+
+	/* Clocked by the shared magnetometer driver, signaled on data_fd */
+	data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((data_fd < 0) || (mag->getHistory()->addListener(data_fd) < 0))
+		STLOGE("VirtualGyroSensor: failed to listen to the magnetometer");
 #if (SENSOR_GEOMAG_ENABLE == 0)
 	iNemoEngine_GeoMag_API_Initialization(100);
 #endif
@@ -83,9 +77,9 @@ VirtualGyroSensor::~VirtualGyroSensor()
 	if (mEnabled) {
 		enable(SENSORS_VIRTUAL_GYROSCOPE_HANDLE, 0, 0);
 	}
-	pthread_mutex_destroy(&dataMutex);
-	acc->~SensorBase();
-	mag->~SensorBase();
+	mag->getHistory()->removeListener(data_fd);
+	acc->put();
+	mag->put();
 }
 
 int VirtualGyroSensor::setInitialState()
@@ -94,6 +88,8 @@ int VirtualGyroSensor::setInitialState()
 	setFullScale(SENSORS_VIRTUAL_GYROSCOPE_HANDLE,
 		     VIRTUAL_GYRO_DEFAULT_FULLSCALE);
 	startup_samples = samples_to_discard;
+	mCursor = mag->getHistory()->getHead();
+	pre_time = -1;
 
 	return 0;
 }
@@ -139,6 +135,13 @@ int VirtualGyroSensor::enable(int32_t handle, int en, int type)
 	if (what < 0)
 		return what;
 
+#if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
+	mag->beginConfig();
+#endif
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	acc->beginConfig();
+#endif
+
 	if (flags) {
 		if (!mEnabled) {
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
@@ -173,6 +176,15 @@ int VirtualGyroSensor::enable(int32_t handle, int en, int type)
 		setDelay(handle, DELAY_OFF);
 	}
 
+#if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
+	if (mag->commitConfig() < 0)
+		err = -1;
+#endif
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	if (acc->commitConfig() < 0)
+		err = -1;
+#endif
+
 	if(err >= 0 ) {
 		STLOGD("VirtualGyroSensor::enable(%d), handle: %d, what: %d,"
 				" mEnabled: %x",flags, handle, what, mEnabled);
@@ -186,7 +198,13 @@ int VirtualGyroSensor::enable(int32_t handle, int en, int type)
 
 bool VirtualGyroSensor::hasPendingEvents() const
 {
-	return mHasPendingEvent;
+	return mHasPendingEvent ||
+		(mEnabled && (mCursor != mag->getHistory()->getHead()));
+}
+
+int VirtualGyroSensor::getFd() const
+{
+	return data_fd;
 }
 
 int VirtualGyroSensor::setDelay(int32_t handle, int64_t delay_ns)
@@ -249,10 +267,8 @@ void VirtualGyroSensor::updateDecimations(int64_t delayms)
 	/** Decimation Definition */
 	for(kk = 0; kk < numSensors; kk++)
 	{
-		if (delayms)
-			DecimationBuffer[kk] = setDelayBuffer[kk] / delayms;
-		else
-			DecimationBuffer[kk] = 0;
+		Decimation[kk].setPeriod(delayms ?
+				MSEC_TO_NSEC(setDelayBuffer[kk]) : 0);
 	}
 
 #if (DEBUG_POLL_RATE == 1)
@@ -262,8 +278,8 @@ void VirtualGyroSensor::updateDecimations(int64_t delayms)
 			"mEnabled = %d", delayms, mEnabled);
 	STLOGD("VirtualGyroSensor::samples_to_discard = %d",
 			samples_to_discard);
-	STLOGD("VirtualGyroSensor::DecimationBuffer = %d, %d, %d",
-	       DecimationBuffer[0], DecimationBuffer[1], DecimationBuffer[2]);
+	STLOGD("VirtualGyroSensor::Decimation periods = %lld, %lld, %lld",
+	       Decimation[0].getPeriod(), Decimation[1].getPeriod(), Decimation[2].getPeriod());
 #endif
 
 }
@@ -292,12 +308,10 @@ int VirtualGyroSensor::setFullScale(int32_t handle, int value)
 int VirtualGyroSensor::readEvents(sensors_event_t* data, int count)
 {
 	int numEventReceived = 0, deltatime = 0;
-	input_event const* event;
 	iNemoGeoMagSensorsData sdata;
-	static int64_t pre_time = -1;
 	int64_t cur_time = 0;
-	float tmp[3];
 	int64_t newMagDelay_ms = MAG_DEFAULT_DELAY;
+	uint64_t signaled;
 
 	if (count < 1)
 		return -EINVAL;
@@ -306,110 +320,95 @@ int VirtualGyroSensor::readEvents(sensors_event_t* data, int count)
 		mHasPendingEvent = false;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
-	if (n < 0)
-		return n;
-
-	while (count && mInputReader.readEvent(&event)) {
-		if (event->type == EV_SYN) {
-			if (startup_samples) {
-				startup_samples--;
+	if (read(data_fd, &signaled, sizeof(signaled)) < 0)
+		signaled = 0;
 
-#if (DEBUG_VIRTUAL_GYROSCOPE == 1)
-				STLOGD("VirtualGyroSensor::Start-up samples = %d",
-				       startup_samples);
-#endif
-				goto no_data;
-			}
+	if (!mEnabled) {
+		mCursor = mag->getHistory()->getHead();
+		return 0;
+	}
 
+	VirtualGyroSensor::mag->getMagDelay(&newMagDelay_ms);
+	if (newMagDelay_ms != MagDelay_ms) {
+		updateDecimations(newMagDelay_ms);
+		MagDelay_ms = newMagDelay_ms;
+	}
 
-			VirtualGyroSensor::mag->getMagDelay(&newMagDelay_ms);
-			if((newMagDelay_ms != MagDelay_ms) && mEnabled) {
-				updateDecimations(newMagDelay_ms);
-				MagDelay_ms = newMagDelay_ms;
-			}
+	while (count && mag->getHistory()->readNext(&mCursor,
+			&mSensorsBufferedVectors[MagneticField], &cur_time)) {
+		if (startup_samples) {
+			startup_samples--;
 
+#if (DEBUG_VIRTUAL_GYROSCOPE == 1)
+			STLOGD("VirtualGyroSensor::Start-up samples = %d",
+			       startup_samples);
+#endif
+			continue;
+		}
 
 #if (SENSOR_GEOMAG_ENABLE == 0)
-			/* GeoMag library execution here only if GeoMag sensors are disabled */
-			AccelSensor::getBufferData(&mSensorsBufferedVectors[Acceleration]);
-			MagnSensor::getBufferData(&mSensorsBufferedVectors[MagneticField]);
+		/* GeoMag library execution here only if GeoMag sensors are disabled */
+		acc->getHistory()->readAt(&mSensorsBufferedVectors[Acceleration], cur_time);
 
-			/** Copy accelerometer data [m/s^2] */
-			memcpy(sdata.accel, mSensorsBufferedVectors[Acceleration].v, sizeof(float) * 3);
+		/** Copy accelerometer data [m/s^2] */
+		memcpy(sdata.accel, mSensorsBufferedVectors[Acceleration].v, sizeof(float) * 3);
 
-			/** Copy magnetometer data [uT] */
-			memcpy(sdata.magn, mSensorsBufferedVectors[MagneticField].v, sizeof(float) * 3);
+		/** Copy magnetometer data [uT] */
+		memcpy(sdata.magn, mSensorsBufferedVectors[MagneticField].v, sizeof(float) * 3);
 
-			cur_time = timevalToNano(event->time);
-			if (pre_time > 0)
-				deltatime = (int)NSEC_TO_MSEC(cur_time - pre_time);
-			pre_time = cur_time;
-			deltatime = (deltatime == 0) ? mag->getDelayms() : deltatime;
+		if (pre_time > 0)
+			deltatime = (int)NSEC_TO_MSEC(cur_time - pre_time);
+		pre_time = cur_time;
+		deltatime = (deltatime == 0) ? mag->getDelayms() : deltatime;
 
-			iNemoEngine_GeoMag_API_Run(deltatime, &sdata);
+		iNemoEngine_GeoMag_API_Run(deltatime, &sdata);
 #endif
-			iNemoEngine_GeoMag_API_Get_VirtualGyro(gyro);
-
-			DecimationCount++;
-
-			if(mEnabled & (1<<VirtualGyro) && (DecimationCount
-				>= DecimationBuffer[VirtualGyro])) {
-				/** Downsample VirtualGyro output */
-				DecimationCount = 0;
-				mPendingEvent[VirtualGyro].data[0] = gyro[0];
-				mPendingEvent[VirtualGyro].data[1] = gyro[1];
-				mPendingEvent[VirtualGyro].data[2] = gyro[2];
-				mPendingEvent[VirtualGyro].timestamp =
-						timevalToNano(event->time);
-				mPendingEvent[VirtualGyro].gyro.status =
-						SENSOR_STATUS_ACCURACY_HIGH;
-
-				*data++ = mPendingEvent[VirtualGyro];
-				count--;
-				numEventReceived++;
-			}
-
-			if(mEnabled & (1 << iNemoGyro)) {
-				/** Save axis data for iNemo library */
-				sensors_vec_t sData;
-				sData.x = gyro[0];
-				sData.y = gyro[1];
-				sData.z = gyro[2];
-				setBufferData(&sData);
-			}
+		iNemoEngine_GeoMag_API_Get_VirtualGyro(gyro);
+
+		if(mEnabled & (1<<VirtualGyro) &&
+			Decimation[VirtualGyro].sample(cur_time)) {
+			/** Downsample VirtualGyro output */
+			mPendingEvent[VirtualGyro].data[0] = gyro[0];
+			mPendingEvent[VirtualGyro].data[1] = gyro[1];
+			mPendingEvent[VirtualGyro].data[2] = gyro[2];
+			mPendingEvent[VirtualGyro].timestamp = cur_time;
+			mPendingEvent[VirtualGyro].gyro.status =
+					SENSOR_STATUS_ACCURACY_HIGH;
+
+			*data++ = mPendingEvent[VirtualGyro];
+			count--;
+			numEventReceived++;
+		}
+
+		if(mEnabled & (1 << iNemoGyro)) {
+			/** Save axis data for iNemo library */
+			sensors_vec_t sData;
+			sData.x = gyro[0];
+			sData.y = gyro[1];
+			sData.z = gyro[2];
+			setBufferData(&sData, cur_time);
+		}
 
 #if (DEBUG_VIRTUAL_GYROSCOPE == 1)
-			STLOGD("VirtualGyroSensor::readEvents (time = %lld),"
-			" count(%d), received(%d)",
-				mPendingEvent[VirtualGyro].timestamp, count,
-				numEventReceived);
+		STLOGD("VirtualGyroSensor::readEvents (time = %lld),"
+		" count(%d), received(%d)",
+			mPendingEvent[VirtualGyro].timestamp, count,
+			numEventReceived);
 #endif
-		}
-no_data:
-		mInputReader.next();
 	}
 	return numEventReceived;
 }
 
-bool VirtualGyroSensor::setBufferData(sensors_vec_t *value)
+bool VirtualGyroSensor::setBufferData(sensors_vec_t *value, int64_t timestamp)
 {
-	pthread_mutex_lock(&dataMutex);
-	dataBuffer.x = value->x;
-	dataBuffer.y = value->y;
-	dataBuffer.z = value->z;
-	pthread_mutex_unlock(&dataMutex);
+	dataBuffer.write(value, timestamp);
 
 	return true;
 }
 
 bool VirtualGyroSensor::getBufferData(sensors_vec_t *lastBufferedValues)
 {
-	pthread_mutex_lock(&dataMutex);
-	lastBufferedValues->x = dataBuffer.x;
-	lastBufferedValues->y = dataBuffer.y;
-	lastBufferedValues->z = dataBuffer.z;
-	pthread_mutex_unlock(&dataMutex);
+	dataBuffer.read(lastBufferedValues);
 #if (DEBUG_VIRTUAL_GYROSCOPE == 1)
 	STLOGD("VirtualGyroSensor: getBufferData got values: x:(%f),"
 		"y:(%f), z:(%f).", lastBufferedValues->x,
@@ -31,7 +31,8 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
-#include "InputEventReader.h"
+#include "Decimator.h"
+#include "SensorHistory.h"
 #include "MagnSensor.h"
 #include "AccelSensor.h"
 
@@ -42,8 +43,6 @@ extern "C"
 
 /*****************************************************************************/
 
-struct input_event;
-
 class VirtualGyroSensor : public SensorBase
 {
 	enum {
@@ -53,41 +52,41 @@ class VirtualGyroSensor : public SensorBase
 		iNemoGyro,
 		numSensors
 	};
-	static int mEnabled;
-	static int64_t delayms;
-	static int current_fullscale;
+	int mEnabled;
+	int64_t delayms;
+	int current_fullscale;
 	sensors_event_t mPendingEvent[numSensors];
 	int setInitialState();
-	InputEventCircularReader mInputReader;
 	bool mHasPendingEvent;
 	sensors_vec_t mSensorsBufferedVectors[2];
 
 private:
-	static int startup_samples;
-	static int samples_to_discard;
-	static sensors_vec_t dataBuffer;
-	static int64_t MagDelay_ms;
-	static int64_t setDelayBuffer[numSensors];
-	static int DecimationBuffer[numSensors];
-	static int DecimationCount;
-	virtual bool setBufferData(sensors_vec_t *value);
+	int startup_samples;
+	int samples_to_discard;
+	SensorHistory dataBuffer;
+	int64_t MagDelay_ms;
+	int64_t setDelayBuffer[numSensors];
+	Decimator Decimation[numSensors];
+	virtual bool setBufferData(sensors_vec_t *value, int64_t timestamp);
 
 	float gyro[3];
 	MagnSensor *mag;
 	AccelSensor *acc;
-	static pthread_mutex_t dataMutex;
+	uint32_t mCursor;		/* next magnetometer sample to process */
+	int64_t pre_time;		/* timestamp of the last processed sample */
 
 public:
 	VirtualGyroSensor();
 	virtual ~VirtualGyroSensor();
 	virtual int readEvents(sensors_event_t *data, int count);
 	virtual bool hasPendingEvents() const;
+	virtual int getFd() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
 	virtual void updateDecimations(int64_t Delay_ms);
 	virtual int setFullScale(int32_t handle, int value);
 	virtual int enable(int32_t handle, int enabled, int type);
-	static bool getBufferData(sensors_vec_t *lastBufferedValues);
-	static void getGyroDelay(int64_t *Gyro_Delay_ms);
+	bool getBufferData(sensors_vec_t *lastBufferedValues);
+	void getGyroDelay(int64_t *Gyro_Delay_ms);
 	virtual int getWhatFromHandle(int32_t handle);
 };
 
@@ -34,6 +34,9 @@
 #define MAGN_MAX_ODR			80					// Set Max value of ODR [Hz]
 #define MAGN_POWER_CONSUMPTION		0.077f					// Set sensor's power consumption [mA]
 #define MAGN_DEFAULT_FULLSCALE		8					// Set default full-scale (value depends on the driver sysfs file)
+#define MAGN_IIO_ENABLE			0					// Read scans from the IIO buffer instead of the input device -> [0]:off, [1]:on
+#define SENSOR_IIO_MAGNETIC_FIELD	"lis3mdl"				// Name of IIO device: iio_dev->name
+#define MAGN_IIO_CHANNEL		"magn"					// Scan elements: in_magn_{x,y,z}
 
 /* INEMO_ENGINE SENSOR */
 #define MAG_DEFAULT_RANGE		8					// full scale set to +-2.5Gauss (value depends on the driver sysfs file)
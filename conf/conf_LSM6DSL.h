@@ -39,6 +39,9 @@
 #define ACCEL_MIN_ODR				13					// Set Min value of ODR [Hz]
 #define ACCEL_POWER_CONSUMPTION			0.6f				// Set sensor's power consumption [mA]
 #define ACCEL_DEFAULT_FULLSCALE			4					// Set default full-scale (value depends on the driver sysfs file)
+#define ACCEL_IIO_ENABLE			0					// Read scans from the IIO buffer instead of the input device -> [0]:off, [1]:on
+#define SENSOR_IIO_ACCELEROMETER		"lsm6dsl_accel"				// Name of IIO device: iio_dev->name
+#define ACCEL_IIO_CHANNEL			"accel"					// Scan elements: in_accel_{x,y,z}
 
 /* GYROSCOPE SENSOR */
 #define SENSOR_GYRO_LABEL			"LSM6DSL 3-axis Gyroscope sensor"	// Label views in Android Applications
@@ -51,6 +54,9 @@
 #define GYRO_MIN_ODR				13					// Set Min value of ODR [Hz]
 #define GYRO_POWER_CONSUMPTION			4.0f					// Set sensor's power consumption [mA]
 #define GYRO_DEFAULT_FULLSCALE			2000					// Set default full-scale (value depends on the driver sysfs file)
+#define GYRO_IIO_ENABLE				0					// Read scans from the IIO buffer instead of the input device -> [0]:off, [1]:on
+#define SENSOR_IIO_GYROSCOPE			"lsm6dsl_gyro"				// Name of IIO device: iio_dev->name
+#define GYRO_IIO_CHANNEL			"anglvel"				// Scan elements: in_anglvel_{x,y,z}
 #define TO_MDPS(x)				(x / 1000000.0f)
 
 /* TILT SENSOR */
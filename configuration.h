@@ -32,6 +32,7 @@
 #define ANDROID_KK				(19)
 #define ANDROID_L				(21)
 #define ANDROID_M				(23)
+#define ANDROID_O				(26)
 
 #if (ANDROID_VERSION >= ANDROID_JBMR2)
   #define OS_VERSION_ENABLE			(1)
@@ -39,6 +40,15 @@
   #define OS_VERSION_ENABLE			(0)
 #endif
 
+/* Built-in fusion engine in place of the iNemoEngine library under lib/ */
+#if defined(OPEN_FUSION)
+  #define SENSORS_OPEN_FUSION_ENABLE		(1)
+  #undef SENSOR_FUSION_MODULE_PRESENT
+  #define SENSOR_FUSION_MODULE_PRESENT		(1)
+#else
+  #define SENSORS_OPEN_FUSION_ENABLE		(0)
+#endif
+
 #if defined(LSM330D)
   #include "conf_LSM330D.h"
 #endif
@@ -154,6 +164,48 @@
   #include "conf_FILE_CALIB.h"
 #endif
 
+/* Time base of the event timestamps: SystemClock.elapsedRealtimeNanos() */
+#define SENSORS_CLOCK_ID			CLOCK_BOOTTIME
+
+/* Drain every driver on a dedicated reader thread */
+#if defined(READER_THREADS)
+  #define SENSORS_READER_THREADS_ENABLE		(1)
+#else
+  #define SENSORS_READER_THREADS_ENABLE		(0)
+#endif
+
+/* Run the sensor fusion on its own thread, with real-time scheduling */
+#if defined(FUSION_THREAD)
+  #define SENSORS_FUSION_THREAD_ENABLE		(1)
+#else
+  #define SENSORS_FUSION_THREAD_ENABLE		(0)
+#endif
+#define SENSORS_FUSION_THREAD_PRIORITY		(10)	/* SCHED_FIFO priority, 0: default policy */
+#define SENSORS_FUSION_THREAD_CPU		(-1)	/* CPU the thread is bound to, -1: any */
+
+/* Extrapolate rotation vectors forward to compensate the delivery latency */
+#if defined(ROT_PREDICTION)
+  #define SENSORS_ROTATION_PREDICTION_ENABLE	(1)
+#else
+  #define SENSORS_ROTATION_PREDICTION_ENABLE	(0)
+#endif
+#define SENSORS_ROTATION_PREDICTION_MS		(15)	/* prediction horizon [ms] */
+
+/* Average the samples dropped by decimation of accel, gyro, magn clients */
+#if defined(DECIM_FILTER)
+  #define SENSORS_DECIMATION_FILTER_ENABLE	(1)
+#else
+  #define SENSORS_DECIMATION_FILTER_ENABLE	(0)
+#endif
+
+/*
+ * IMUs of the configured model on the board (redundant-IMU products). The
+ * extra ones are the next devices with the same input/IIO name, in
+ * enumeration order, and report accelerometer and gyroscope under their
+ * own handles. Fusion and the other logical sensors use the first one.
+ */
+#define SENSORS_IMU_INSTANCES			(1)
+
 #ifdef SENSORS_ORIENTATION_ENABLE
  #if (SENSORS_ORIENTATION_ENABLE == 1)
   #undef GEOMAG_COMPASS_ORIENTATION_ENABLE
@@ -175,6 +227,12 @@
   #define SENSORS_GYROSCOPE_ENABLE 		(0)
 #endif
 
+/* The rotation prediction extrapolates at the rate of the gyroscope */
+#if (SENSORS_GYROSCOPE_ENABLE == 0)
+  #undef SENSORS_ROTATION_PREDICTION_ENABLE
+  #define SENSORS_ROTATION_PREDICTION_ENABLE	(0)
+#endif
+
 #ifndef SENSORS_ACCELEROMETER_ENABLE
   #define SENSORS_ACCELEROMETER_ENABLE 		(0)
 #endif
@@ -187,6 +245,19 @@
   #define SENSORS_PRESSURE_ENABLE 		(0)
 #endif
 
+/* Input device backend unless the conf selects the IIO buffer */
+#ifndef ACCEL_IIO_ENABLE
+  #define ACCEL_IIO_ENABLE			(0)
+#endif
+
+#ifndef GYRO_IIO_ENABLE
+  #define GYRO_IIO_ENABLE			(0)
+#endif
+
+#ifndef MAGN_IIO_ENABLE
+  #define MAGN_IIO_ENABLE			(0)
+#endif
+
 /* Sensors power consumption */
 #if (GYROSCOPE_GBIAS_ESTIMATION_STANDALONE == 1)
   #define UNCALIB_GYRO_POWER_CONSUMPTION 	(GYRO_POWER_CONSUMPTION + ACCEL_POWER_CONSUMPTION)
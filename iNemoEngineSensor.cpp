@@ -25,66 +25,71 @@
 #include <poll.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <sys/eventfd.h>
 #include <sys/select.h>
 #include <cutils/log.h>
 #include <linux/time.h>
 #include <string.h>
 #include "iNemoEngineSensor.h"
 
-#define FETCH_FULL_EVENT_BEFORE_RETURN		0
+/* Samples further apart than this many periods are a gap in the data */
+#define FUSION_GAP_PERIODS			3
 
-/*****************************************************************************/
-#if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
-MagnSensor* iNemoEngineSensor::mag = NULL;
-#endif
-#if (SENSORS_ACCELEROMETER_ENABLE == 1)
-AccelSensor* iNemoEngineSensor::acc = NULL;
-#endif
-#if (SENSORS_GYROSCOPE_ENABLE == 1)
-GyroSensor* iNemoEngineSensor::gyr = NULL;
-#endif
-int iNemoEngineSensor::status = 0;
-int iNemoEngineSensor::mEnabled = 0;
-int iNemoEngineSensor::startup_samples = DEFAULT_SAMPLES_TO_DISCARD;
-int iNemoEngineSensor::samples_to_discard = DEFAULT_SAMPLES_TO_DISCARD;
-int iNemoEngineSensor::DecimationBuffer[numSensors] = {0};
-int iNemoEngineSensor::DecimationCount[numSensors] = {0};
-int64_t iNemoEngineSensor::DelayBuffer[numSensors] = {0};
-int64_t iNemoEngineSensor::gyroDelay_ms = GYR_DEFAULT_DELAY;
-
-struct timespec old_time, new_time;
+#if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+#define ROTATION_PREDICTION_NS			MSEC_TO_NSEC((int64_t)SENSORS_ROTATION_PREDICTION_MS)
 
-
-int64_t timespecDiff(struct timespec *timeA_p, struct timespec *timeB_p)
+/*
+ * Extrapolate a rotation vector (x, y, z, w) by horizon ns, at the angular
+ * rate measured in device frame: q' = q * exp(rate * horizon / 2)
+ */
+static void predictRotation(float *q, const float *rate, int64_t horizon)
 {
-	int64_t timeAft;
-	int64_t timeBef;
-	int64_t timeDiff;
-
-	timeBef = (int64_t)((int64_t)(timeB_p->tv_sec * 1000000000L) + timeB_p->tv_nsec);
-	timeAft = (int64_t)((int64_t)(timeA_p->tv_sec * 1000000000L) + timeA_p->tv_nsec);
-
-	if (timeAft > timeBef)
-		timeDiff = timeAft - timeBef;
-	else
-		timeDiff = timeBef - timeAft;
-
-	return (int64_t)timeDiff;
+	float a[3], dq[4], r[4], theta, s;
+	float h = (float)horizon * 0.5e-9f;
+	int i;
+
+	for (i = 0; i < 3; i++)
+		a[i] = rate[i] * h;
+
+	theta = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+	if (theta < 1e-6f)
+		return;
+
+	s = sinf(theta) / theta;
+	dq[0] = a[0] * s;
+	dq[1] = a[1] * s;
+	dq[2] = a[2] * s;
+	dq[3] = cosf(theta);
+
+	r[0] = q[3] * dq[0] + q[0] * dq[3] + q[1] * dq[2] - q[2] * dq[1];
+	r[1] = q[3] * dq[1] - q[0] * dq[2] + q[1] * dq[3] + q[2] * dq[0];
+	r[2] = q[3] * dq[2] + q[0] * dq[1] - q[1] * dq[0] + q[2] * dq[3];
+	r[3] = q[3] * dq[3] - q[0] * dq[0] - q[1] * dq[1] - q[2] * dq[2];
+
+	/* keep the scalar part positive, as the framework expects */
+	s = (r[3] < 0.0f) ? -1.0f : 1.0f;
+	for (i = 0; i < 4; i++)
+		q[i] = s * r[i];
 }
+#endif
 
+/*****************************************************************************/
 iNemoEngineSensor::iNemoEngineSensor()
-#if (!SENSORS_GYROSCOPE_ENABLE && SENSORS_VIRTUAL_GYROSCOPE_ENABLE)
-        : SensorBase(NULL, SENSOR_DATANAME_ACCELEROMETER),
-#else
-        : SensorBase(NULL, SENSOR_DATANAME_GYROSCOPE),
-#endif
+	: SensorBase(NULL, NULL),
+	mEnabled(0),
 	mPendingMask(0),
-	mInputReader(4),
-	mHasPendingEvent(false)
+	mPredictedMask(0),
+	mHasPendingEvent(false),
+	mClock(NULL),
+	mCursor(0),
+	mFusionTimestamp(0)
 {
+	startup_samples = DEFAULT_SAMPLES_TO_DISCARD;
+	samples_to_discard = DEFAULT_SAMPLES_TO_DISCARD;
+	gyroDelay_ms = GYR_DEFAULT_DELAY;
+	memset(DelayBuffer, 0, sizeof(DelayBuffer));
 	memset(mPendingEvents, 0, sizeof(mPendingEvents));
 	memset(mSensorsBufferedVectors, 0, sizeof(sensors_vec_t) * 3);
-	memset(DecimationCount, 0, sizeof(DecimationCount));
 
 #if (SENSORS_ORIENTATION_ENABLE == 1)
 	mPendingEvents[Orientation].version = sizeof(sensors_event_t);
@@ -127,12 +132,6 @@ iNemoEngineSensor::iNemoEngineSensor()
 	mPendingEvents[CalibGyro].gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
 #endif
 
-	if (data_fd) {
-		STLOGI("iNemoSensor::iNemoSensor main driver device_sysfs_path:(%s)", sysfs_device_path);
-	} else {
-		STLOGE("iNemoSensor::iNemoSensor main driver device_sysfs_path:(%s) not found", sysfs_device_path);
-	}
-
 	init_data_api.GbiasLearningMode = 2;
 	init_data_api.ATime = -1;
 	init_data_api.MTime = -1;
@@ -151,38 +150,56 @@ iNemoEngineSensor::iNemoEngineSensor()
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
 	init_data_api.Gbias_threshold_accel = ACC_GBIAS_THRESHOLD;
 	debug_init_data_api.accel_flag = 1;
-	iNemoEngineSensor::acc = new AccelSensor();
+	acc = AccelSensor::getInstance();
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 	init_data_api.Gbias_threshold_magn = MAG_GBIAS_THRESHOLD;
 	debug_init_data_api.magn_flag = 1;
-	iNemoEngineSensor::mag = new MagnSensor();
+	mag = MagnSensor::getInstance();
 #endif
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
 	debug_init_data_api.gyro_flag = 1;
 	init_data_api.Gbias_threshold_gyro = GYR_GBIAS_THRESHOLD;
-	iNemoEngineSensor::gyr = new GyroSensor();
+	gyr = GyroSensor::getInstance();
 #endif
+
+	/*
+	 * The fusion runs on the samples published by the shared gyroscope
+	 * (accelerometer with the virtual gyroscope) driver, which signals
+	 * data_fd once per processed block.
+	 */
+#if (SENSORS_GYROSCOPE_ENABLE == 1)
+	mClock = gyr->getHistory();
+#else
+	mClock = acc->getHistory();
+#endif
+	data_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((data_fd < 0) || (mClock->addListener(data_fd) < 0))
+		STLOGE("iNemoSensor:: failed to listen to the fusion clock sensor");
+
 	if (iNemoEngine_API_Initialization(&init_data_api, &debug_init_data_api) < 0)
 		STLOGE("iNemoSensor:: Failed to initialize iNemoEngineAPI library");
 }
 
 iNemoEngineSensor::~iNemoEngineSensor()
 {
+	mClock->removeListener(data_fd);
+
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-	iNemoEngineSensor::gyr->~GyroSensor();
+	gyr->put();
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
-	iNemoEngineSensor::mag->~MagnSensor();
+	mag->put();
 #endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	iNemoEngineSensor::acc->~AccelSensor();
+	acc->put();
 #endif
 }
 
 int iNemoEngineSensor::setInitialState()
 {
 	startup_samples = samples_to_discard;
+	mCursor = mClock->getHead();
 
 	return 0;
 }
@@ -235,24 +252,61 @@ int iNemoEngineSensor::getWhatFromHandle(int32_t handle)
 	return what;
 }
 
+/*
+ * Group the enable, full-scale and delay changes of the physical sensors
+ * so that each of them is reprogrammed once per fusion reconfiguration.
+ */
+void iNemoEngineSensor::beginDevicesConfig()
+{
+#if (SENSORS_GYROSCOPE_ENABLE == 1)
+	gyr->beginConfig();
+#endif
+#if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
+	mag->beginConfig();
+#endif
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	acc->beginConfig();
+#endif
+}
+
+int iNemoEngineSensor::commitDevicesConfig()
+{
+	int err = 0;
+
+#if (SENSORS_GYROSCOPE_ENABLE == 1)
+	if (gyr->commitConfig() < 0)
+		err = -1;
+#endif
+#if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
+	if (mag->commitConfig() < 0)
+		err = -1;
+#endif
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	if (acc->commitConfig() < 0)
+		err = -1;
+#endif
+
+	return err;
+}
+
 int iNemoEngineSensor::enable(int32_t handle, int en, int  __attribute__((unused))type)
 {
 	int err = 0;
 	int what = -1;
-	static int enabled = 0;
+	int enabled = 0;
 
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-	if (iNemoEngineSensor::gyr->getFd() <= 0)
+	if (gyr->getFd() <= 0)
 		return -1;
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 	if (handle != SENSORS_GAME_ROTATION_HANDLE) {
-		if (iNemoEngineSensor::mag->getFd() <= 0)
+		if (mag->getFd() <= 0)
 			return -1;
 	}
 #endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	if (iNemoEngineSensor::acc->getFd() <= 0)
+	if (acc->getFd() <= 0)
 		return -1;
 #endif
 
@@ -260,23 +314,25 @@ int iNemoEngineSensor::enable(int32_t handle, int en, int  __attribute__((unused
 	if (what < 0)
 		return what;
 
+	beginDevicesConfig();
+
 	if(en) {
 		if(mEnabled == 0) {
 			enabled = 1;
 
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 			if (handle != SENSORS_GAME_ROTATION_HANDLE) {
-				iNemoEngineSensor::mag->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
-				iNemoEngineSensor::mag->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, MAG_DEFAULT_RANGE);
+				mag->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
+				mag->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, MAG_DEFAULT_RANGE);
 			}
 #endif
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-			iNemoEngineSensor::gyr->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
-			iNemoEngineSensor::gyr->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, GYRO_DEFAULT_RANGE);
+			gyr->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
+			gyr->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, GYRO_DEFAULT_RANGE);
 #endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			iNemoEngineSensor::acc->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
-			iNemoEngineSensor::acc->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, ACC_DEFAULT_RANGE);
+			acc->enable(SENSORS_SENSOR_FUSION_HANDLE, 1, 1);
+			acc->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, ACC_DEFAULT_RANGE);
 #endif
 
 		}
@@ -286,22 +342,24 @@ int iNemoEngineSensor::enable(int32_t handle, int en, int  __attribute__((unused
 		mEnabled &= ~(1<<what);
 		if((mEnabled == 0)&&(tmp != 0)) {
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-			iNemoEngineSensor::gyr->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, GYRO_DEFAULT_RANGE);
-			iNemoEngineSensor::gyr->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
+			gyr->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, GYRO_DEFAULT_RANGE);
+			gyr->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 			if (handle != SENSORS_GAME_ROTATION_HANDLE) {
-				iNemoEngineSensor::mag->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, MAG_DEFAULT_RANGE);
-				iNemoEngineSensor::mag->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
+				mag->setFullScale(SENSORS_SENSOR_FUSION_HANDLE, MAG_DEFAULT_RANGE);
+				mag->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
 			}
 #endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			iNemoEngineSensor::acc->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
+			acc->enable(SENSORS_SENSOR_FUSION_HANDLE, 0, 1);
 #endif
 		}
 		setDelay(handle, DELAY_OFF);
 	}
 
+	err = commitDevicesConfig();
+
 	if ((handle == SENSORS_GAME_ROTATION_HANDLE) ||
 		(handle == SENSORS_GYROSCOPE_HANDLE) ||
 		(handle == SENSORS_UNCALIB_GYROSCOPE_HANDLE))
@@ -341,7 +399,7 @@ int iNemoEngineSensor::enable(int32_t handle, int en, int  __attribute__((unused
 	if (enabled) {
 		enabled = 0;
 		setInitialState();
-		clock_gettime(CLOCK_MONOTONIC, &old_time);
+		mFusionTimestamp = 0;
 	}
 
 	return err;
@@ -349,7 +407,13 @@ int iNemoEngineSensor::enable(int32_t handle, int en, int  __attribute__((unused
 
 bool iNemoEngineSensor::hasPendingEvents() const
 {
-	return mHasPendingEvent;
+	/* Samples left behind when the caller ran out of room */
+	return mHasPendingEvent || (mEnabled && (mCursor != mClock->getHead()));
+}
+
+int iNemoEngineSensor::getFd() const
+{
+	return data_fd;
 }
 
 int iNemoEngineSensor::setDelay(int32_t handle, int64_t delay_ns)
@@ -385,19 +449,19 @@ int iNemoEngineSensor::setDelay(int32_t handle, int64_t delay_ns)
 
 
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-		err = iNemoEngineSensor::gyr->setDelay(SENSORS_SENSOR_FUSION_HANDLE, gyr_delay_ms);
+		err = gyr->setDelay(SENSORS_SENSOR_FUSION_HANDLE, gyr_delay_ms);
 		if(err < 0)
 			return -1;
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 		if (handle != SENSORS_GAME_ROTATION_HANDLE) {
-			err = iNemoEngineSensor::mag->setDelay(SENSORS_SENSOR_FUSION_HANDLE, mag_delay_ms);
+			err = mag->setDelay(SENSORS_SENSOR_FUSION_HANDLE, mag_delay_ms);
 			if(err < 0)
 				return -1;
 		}
 #endif
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-		err = iNemoEngineSensor::acc->setDelay(SENSORS_SENSOR_FUSION_HANDLE, acc_delay_ms);
+		err = acc->setDelay(SENSORS_SENSOR_FUSION_HANDLE, acc_delay_ms);
 		if(err < 0)
 			return -1;
 #endif
@@ -412,6 +476,41 @@ int iNemoEngineSensor::setDelay(int32_t handle, int64_t delay_ns)
 	return 0;
 }
 
+/*
+ * Fusion integration step from the sample timestamps, so that it follows
+ * the sample spacing and not the HAL scheduling. Repeated or out of order
+ * timestamps give no step; after a gap (e.g. a suspended device) only one
+ * nominal period is integrated.
+ */
+int64_t iNemoEngineSensor::getFusionTimeElapsed(int64_t timestamp)
+{
+	int64_t period = MSEC_TO_NSEC(gyroDelay_ms);
+	int64_t timeElapsed;
+
+	if (!mFusionTimestamp) {
+		mFusionTimestamp = timestamp;
+		return period;
+	}
+
+	timeElapsed = timestamp - mFusionTimestamp;
+	if (timeElapsed < 0) {
+		STLOGE("iNemoSensor:: timestamp went back by %lld ns, restarting",
+		       (long long)-timeElapsed);
+		mFusionTimestamp = timestamp;
+		return 0;
+	}
+
+	mFusionTimestamp = timestamp;
+	if (timeElapsed > FUSION_GAP_PERIODS * period) {
+#if (DEBUG_INEMO_SENSOR == 1)
+		STLOGD("iNemoSensor:: %lld ns gap in the fusion input", (long long)timeElapsed);
+#endif
+		timeElapsed = period;
+	}
+
+	return timeElapsed;
+}
+
 void iNemoEngineSensor::updateDecimations(int64_t delayms)
 {
 	int kk;
@@ -424,38 +523,38 @@ void iNemoEngineSensor::updateDecimations(int64_t delayms)
 	// Decimation Definition
 	for(kk = 0; kk < numSensors; kk++)
 	{
-		if (delayms)
-			DecimationBuffer[kk] = DelayBuffer[kk]/delayms;
-		else
-			DecimationBuffer[kk] = 0;
+		Decimation[kk].setPeriod(delayms ?
+				MSEC_TO_NSEC(DelayBuffer[kk]) : 0);
 	}
 
-	memset(DecimationCount, 0, sizeof(DecimationCount));
 
 #if (DEBUG_POLL_RATE == 1)
 	STLOGD("iNemo::Gyro Delay = %lld", delayms);
 	STLOGD("iNemo::DelayBuffer = %lld, %lld, %lld", DelayBuffer[3], DelayBuffer[4], DelayBuffer[5]);
 	STLOGD("iNemo::DelayBuffer = %lld, %lld, %lld", DelayBuffer[6], DelayBuffer[7], DelayBuffer[8]);
 	STLOGD("iNemo::DelayBuffer = %lld", DelayBuffer[9]);
-	STLOGD("iNemo::DecimationBuffer = %d, %d, %d", DecimationBuffer[3], DecimationBuffer[4], DecimationBuffer[5]);
-	STLOGD("iNemo::DecimationBuffer = %d, %d, %d", DecimationBuffer[6], DecimationBuffer[7], DecimationBuffer[8]);
-	STLOGD("iNemo::DecimationBuffer = %d", DecimationBuffer[9]);
+	STLOGD("iNemo::Decimation periods = %lld, %lld, %lld", Decimation[3].getPeriod(), Decimation[4].getPeriod(), Decimation[5].getPeriod());
+	STLOGD("iNemo::Decimation periods = %lld, %lld, %lld", Decimation[6].getPeriod(), Decimation[7].getPeriod(), Decimation[8].getPeriod());
+	STLOGD("iNemo::Decimation periods = %lld", Decimation[9].getPeriod());
 #endif
 }
 
 int iNemoEngineSensor::readEvents(sensors_event_t *data, int count)
 {
-	static int cont = 0;
 	iNemoSensorsData sdata;
 	int64_t timeElapsed;
 	int64_t newGyroDelay_ms = GYR_DEFAULT_DELAY;
 	int err;
 	int numEventReceived = 0;
-	input_event const* event;
+	sensors_vec_t sample;
+	uint64_t signaled;
 
 #if (GYROSCOPE_GBIAS_ESTIMATION_FUSION == 1)
 	float gbias[3];
 #endif
+#if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+	float rate[3];
+#endif
 
 	if (count < 1)
 		return -EINVAL;
@@ -464,212 +563,193 @@ int iNemoEngineSensor::readEvents(sensors_event_t *data, int count)
 		mHasPendingEvent = false;
 	}
 
-	ssize_t n = mInputReader.fill(data_fd);
-	if (n < 0)
-		return n;
-
-#if (FETCH_FULL_EVENT_BEFORE_RETURN)
-	again:
-#endif
+	if (read(data_fd, &signaled, sizeof(signaled)) < 0)
+		signaled = 0;
 
-	while (count && mInputReader.readEvent(&event)) {
-#if (defined(GYRO_EVENT_HAS_TIMESTAMP) || defined(ACC_EVENT_HAS_TIMESTAMP))
-  #if (!SENSORS_GYROSCOPE_ENABLE && SENSORS_VIRTUAL_GYROSCOPE_ENABLE)
-		if (event->type == EVENT_TYPE_ACCEL) {
-  #else
-		if (event->type == EVENT_TYPE_GYRO) {
-  #endif
-			if (event->code == EVENT_TYPE_TIME_MSB) {
-				timestamp = ((int64_t)(event->value)) << 32;
-			}
-			else if (event->code == EVENT_TYPE_TIME_LSB) {
-				timestamp |= (uint32_t)(event->value);
-			}
-		}
-#endif
-		if(event->type == EV_SYN) {
+	if (!mEnabled) {
+		mCursor = mClock->getHead();
+		return 0;
+	}
 
-			if (startup_samples) {
-				startup_samples--;
-#if (DEBUG_INEMO_SENSOR == 1)
-				STLOGD("iNemo::Start-up samples = %d", startup_samples);
-#endif
-				goto no_data;
-			}
-#if !(defined(GYRO_EVENT_HAS_TIMESTAMP) || defined(ACC_EVENT_HAS_TIMESTAMP))
-	timestamp = timevalToNano(event->time);
-#endif
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-	iNemoEngineSensor::gyr->getGyroDelay(&newGyroDelay_ms);
+	gyr->getGyroDelay(&newGyroDelay_ms);
 #else
-	iNemoEngineSensor::acc->getAccDelay(&newGyroDelay_ms);
+	acc->getAccDelay(&newGyroDelay_ms);
 #endif
 
-	if((newGyroDelay_ms != gyroDelay_ms) && mEnabled) {
+	if (newGyroDelay_ms != gyroDelay_ms) {
 		updateDecimations(newGyroDelay_ms);
 		gyroDelay_ms = newGyroDelay_ms;
 	}
 
-#if (SENSORS_ACCELEROMETER_ENABLE == 1)
-			AccelSensor::getBufferData(&mSensorsBufferedVectors[Acceleration]);
+	while (count && mClock->readNext(&mCursor, &sample, &timestamp)) {
+		if (startup_samples) {
+			startup_samples--;
+#if (DEBUG_INEMO_SENSOR == 1)
+			STLOGD("iNemo::Start-up samples = %d", startup_samples);
 #endif
+			goto no_data;
+		}
+
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-			GyroSensor::getBufferData(&mSensorsBufferedVectors[AngularSpeed]);
+		mSensorsBufferedVectors[AngularSpeed] = sample;
+#endif
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+		acc->getHistory()->readAt(
+				&mSensorsBufferedVectors[Acceleration], timestamp);
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
-			MagnSensor::getBufferData(&mSensorsBufferedVectors[MagneticField]);
+		mag->getHistory()->readAt(
+				&mSensorsBufferedVectors[MagneticField], timestamp);
 #else
-			/* Constant Magnetometer module is passed to the Library when Mag is disabled */
-			mSensorsBufferedVectors[MagneticField].v[0] = 0.0f;
-			mSensorsBufferedVectors[MagneticField].v[1] = 0.7f;
-			mSensorsBufferedVectors[MagneticField].v[2] = 0.7f;
+		/* Constant Magnetometer module is passed to the Library when Mag is disabled */
+		mSensorsBufferedVectors[MagneticField].v[0] = 0.0f;
+		mSensorsBufferedVectors[MagneticField].v[1] = 0.7f;
+		mSensorsBufferedVectors[MagneticField].v[2] = 0.7f;
 #endif
 
-			if (mEnabled & ((1<<Orientation) | (1<<Gravity) |
-					(1<<LinearAcceleration) | (1<<GameRotation) |
-					(1<<UncalibGyro) | (1<<RotationMatrix) |
-					(1<<CalibGyro))) {
-				/** Copy accelerometer data [m/s^2] */
-				memcpy(sdata.accel, mSensorsBufferedVectors[Acceleration].v, sizeof(float) * 3);
+		if (mEnabled & ((1<<Orientation) | (1<<Gravity) |
+				(1<<LinearAcceleration) | (1<<GameRotation) |
+				(1<<UncalibGyro) | (1<<RotationMatrix) |
+				(1<<CalibGyro))) {
+			/** Copy accelerometer data [m/s^2] */
+			memcpy(sdata.accel, mSensorsBufferedVectors[Acceleration].v, sizeof(float) * 3);
 
-				/** Copy magnetometer data [uT] */
-				memcpy(sdata.magn, mSensorsBufferedVectors[MagneticField].v, sizeof(float) * 3);
+			/** Copy magnetometer data [uT] */
+			memcpy(sdata.magn, mSensorsBufferedVectors[MagneticField].v, sizeof(float) * 3);
 
-				/** Copy gyroscope data [rad/sec] */
-				memcpy(sdata.gyro, mSensorsBufferedVectors[AngularSpeed].v, sizeof(float) * 3);
+			/** Copy gyroscope data [rad/sec] */
+			memcpy(sdata.gyro, mSensorsBufferedVectors[AngularSpeed].v, sizeof(float) * 3);
 
 #if (DEBUG_INEMO_SENSOR == 1)
-				STLOGD("Acc_x=%f [m/s^2], Acc_y=%f [m/s^2], Acc_z=%f [m/s^2]", sdata.accel[0], sdata.accel[1], sdata.accel[2]);
-				STLOGD("Mag_x=%f [uT], Mag_y=%f [uT], Mag_z=%f [uT]", sdata.magn[0], sdata.magn[1], sdata.magn[2]);
-				STLOGD("Gyr_x=%f [rad/sec], Gyr_y=%f [rad/sec], Gyr_z=%f [rad/sec]", sdata.gyro[0], sdata.gyro[1], sdata.gyro[2]);
+			STLOGD("Acc_x=%f [m/s^2], Acc_y=%f [m/s^2], Acc_z=%f [m/s^2]", sdata.accel[0], sdata.accel[1], sdata.accel[2]);
+			STLOGD("Mag_x=%f [uT], Mag_y=%f [uT], Mag_z=%f [uT]", sdata.magn[0], sdata.magn[1], sdata.magn[2]);
+			STLOGD("Gyr_x=%f [rad/sec], Gyr_y=%f [rad/sec], Gyr_z=%f [rad/sec]", sdata.gyro[0], sdata.gyro[1], sdata.gyro[2]);
 #endif
-				clock_gettime(CLOCK_MONOTONIC, &new_time);
-				timeElapsed = timespecDiff(&new_time, &old_time);
-				if (timeElapsed > (3 * MSEC_TO_NSEC(GYR_DEFAULT_DELAY)))
-					timeElapsed = MSEC_TO_NSEC(GYR_DEFAULT_DELAY);
+			timeElapsed = getFusionTimeElapsed(timestamp);
+			if (timeElapsed <= 0)
+				goto no_data;
 
-				iNemoEngine_API_Run(timeElapsed, &sdata);
-				old_time = new_time;
+			iNemoEngine_API_Run(timeElapsed, &sdata);
+#if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+			/* bias corrected rate, for the rotation vector prediction */
+			if (iNemoEngine_API_Get_Gbias(rate) != 0)
+				memset(rate, 0, sizeof(rate));
+
+			for (int i = 0; i < 3; i++)
+				rate[i] = sdata.gyro[i] - rate[i];
+#endif
 #if (SENSORS_ORIENTATION_ENABLE == 1)
-				DecimationCount[Orientation]++;
-				if(mEnabled & (1<<Orientation) && (DecimationCount[Orientation] >= DecimationBuffer[Orientation])) {
-					DecimationCount[Orientation] = 0;
-					err = iNemoEngine_API_Get_Euler_Angles(mPendingEvents[Orientation].data);
-					if (err != 0) {
-						goto no_data;
-					}
-
-					mPendingEvents[Orientation].orientation.status = mSensorsBufferedVectors[MagneticField].status;
-					mPendingMask |= 1<<Orientation;
+			if (mEnabled & (1<<Orientation) && Decimation[Orientation].sample(timestamp)) {
+				err = iNemoEngine_API_Get_Euler_Angles(mPendingEvents[Orientation].data);
+				if (err != 0) {
+					goto no_data;
+				}
+
+				mPendingEvents[Orientation].orientation.status = mSensorsBufferedVectors[MagneticField].status;
+				mPendingMask |= 1<<Orientation;
   #if (DEBUG_INEMO_SENSOR == 1)
-					STLOGD("time =  %lld, menabled = %d, orientation = %f", timeElapsed, mEnabled, mPendingEvents[Orientation].data);
+				STLOGD("time =  %lld, menabled = %d, orientation = %f", timeElapsed, mEnabled, mPendingEvents[Orientation].data);
   #endif
-				}
+			}
 #endif
 #if (SENSORS_GRAVITY_ENABLE == 1)
-				DecimationCount[Gravity]++;
-				if(mEnabled & (1<<Gravity) && (DecimationCount[Gravity] >= DecimationBuffer[Gravity])) {
-					DecimationCount[Gravity] = 0;
-					err = iNemoEngine_API_Get_Gravity(mPendingEvents[Gravity].data);
-					if (err != 0)
-						goto no_data;
-
-					mPendingMask |= 1<<Gravity;
-				}
+			if (mEnabled & (1<<Gravity) && Decimation[Gravity].sample(timestamp)) {
+				err = iNemoEngine_API_Get_Gravity(mPendingEvents[Gravity].data);
+				if (err != 0)
+					goto no_data;
+
+				mPendingMask |= 1<<Gravity;
+			}
 #endif
 #if (SENSORS_LINEAR_ACCELERATION_ENABLE == 1)
-				DecimationCount[LinearAcceleration]++;
-				if(mEnabled & (1<<LinearAcceleration) && (DecimationCount[LinearAcceleration] >= DecimationBuffer[LinearAcceleration])) {
-					DecimationCount[LinearAcceleration] = 0;
-					err = iNemoEngine_API_Get_Linear_Acceleration(mPendingEvents[LinearAcceleration].data);
-					if (err != 0)
-						goto no_data;
-
-					mPendingMask |= 1<<LinearAcceleration;
-				}
+			if (mEnabled & (1<<LinearAcceleration) && Decimation[LinearAcceleration].sample(timestamp)) {
+				err = iNemoEngine_API_Get_Linear_Acceleration(mPendingEvents[LinearAcceleration].data);
+				if (err != 0)
+					goto no_data;
+
+				mPendingMask |= 1<<LinearAcceleration;
+			}
 #endif
 #if (SENSORS_ROTATION_VECTOR_ENABLE == 1)
-				DecimationCount[RotationMatrix]++;
-				if(mEnabled & (1<<RotationMatrix) && (DecimationCount[RotationMatrix] >= DecimationBuffer[RotationMatrix])) {
-					DecimationCount[RotationMatrix] = 0;
-					err = iNemoEngine_API_Get_Quaternion(mPendingEvents[RotationMatrix].data);
-					if (err != 0)
-						goto no_data;
-
-					mPendingEvents[RotationMatrix].data[4] = -1;
-					mPendingMask |= 1<<RotationMatrix;
-				}
+			if (mEnabled & (1<<RotationMatrix) && Decimation[RotationMatrix].sample(timestamp)) {
+				err = iNemoEngine_API_Get_Quaternion(mPendingEvents[RotationMatrix].data);
+				if (err != 0)
+					goto no_data;
+
+  #if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+				predictRotation(mPendingEvents[RotationMatrix].data, rate, ROTATION_PREDICTION_NS);
+				mPredictedMask |= 1<<RotationMatrix;
+  #endif
+
+				mPendingEvents[RotationMatrix].data[4] = -1;
+				mPendingMask |= 1<<RotationMatrix;
+			}
 #endif
 #if (SENSORS_GAME_ROTATION_ENABLE == 1)
-				DecimationCount[GameRotation]++;
-				if(mEnabled & (1<<GameRotation) && (DecimationCount[GameRotation] >= DecimationBuffer[GameRotation])) {
-					DecimationCount[GameRotation] = 0;
-					err = iNemoEngine_API_Get_6X_Quaternion(mPendingEvents[GameRotation].data);
-					if (err != 0)
-						goto no_data;
-
-					mPendingMask |= 1<<GameRotation;
-				}
+			if (mEnabled & (1<<GameRotation) && Decimation[GameRotation].sample(timestamp)) {
+				err = iNemoEngine_API_Get_6X_Quaternion(mPendingEvents[GameRotation].data);
+				if (err != 0)
+					goto no_data;
+
+  #if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+				predictRotation(mPendingEvents[GameRotation].data, rate, ROTATION_PREDICTION_NS);
+				mPredictedMask |= 1<<GameRotation;
+  #endif
+
+				mPendingMask |= 1<<GameRotation;
+			}
 #endif
 #if (GYROSCOPE_GBIAS_ESTIMATION_FUSION == 1)
   #if (SENSORS_UNCALIB_GYROSCOPE_ENABLE == 1)
-				DecimationCount[UncalibGyro]++;
-				if(mEnabled & (1<<UncalibGyro) && (DecimationCount[UncalibGyro] >= DecimationBuffer[UncalibGyro])) {
-					DecimationCount[UncalibGyro] = 0;
-
-					err = iNemoEngine_API_Get_Gbias(gbias);
-					if (err != 0)
-						goto no_data;
-
-					int i;
-					for (i = 0 ; i < 3; i++) {
-						mPendingEvents[UncalibGyro].uncalibrated_gyro.uncalib[i] = sdata.gyro[i];
-						mPendingEvents[UncalibGyro].uncalibrated_gyro.bias[i] = gbias[i];
-					}
-					mPendingMask |= 1<<UncalibGyro;
+			if (mEnabled & (1<<UncalibGyro) && Decimation[UncalibGyro].sample(timestamp)) {
+
+				err = iNemoEngine_API_Get_Gbias(gbias);
+				if (err != 0)
+					goto no_data;
+
+				int i;
+				for (i = 0 ; i < 3; i++) {
+					mPendingEvents[UncalibGyro].uncalibrated_gyro.uncalib[i] = sdata.gyro[i];
+					mPendingEvents[UncalibGyro].uncalibrated_gyro.bias[i] = gbias[i];
 				}
+				mPendingMask |= 1<<UncalibGyro;
+			}
   #endif
-				DecimationCount[CalibGyro]++;
-				if(mEnabled & (1<<CalibGyro) && (DecimationCount[CalibGyro] >= DecimationBuffer[CalibGyro])) {
-					DecimationCount[CalibGyro] = 0;
-					err = iNemoEngine_API_Get_Gbias(gbias);
-					if (err != 0)
-						goto no_data;
-
-					int i;
-					for (i = 0 ; i < 3; i++) {
-						mPendingEvents[CalibGyro].data[i] = sdata.gyro[i] - gbias[i];
-					}
-					mPendingMask |= 1<<CalibGyro;
+			if (mEnabled & (1<<CalibGyro) && Decimation[CalibGyro].sample(timestamp)) {
+				err = iNemoEngine_API_Get_Gbias(gbias);
+				if (err != 0)
+					goto no_data;
+
+				int i;
+				for (i = 0 ; i < 3; i++) {
+					mPendingEvents[CalibGyro].data[i] = sdata.gyro[i] - gbias[i];
 				}
-#endif
+				mPendingMask |= 1<<CalibGyro;
 			}
+#endif
+		}
 
 no_data:
-			for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
-				if (mPendingMask & (1<<j)) {
-					mPendingMask &= ~(1<<j);
-					mPendingEvents[j].timestamp = timestamp;
-					if (mEnabled & (1<<j)) {
-						*data++ = mPendingEvents[j];
-						count--;
-						numEventReceived++;
-					}
+		for (int j=0 ; count && mPendingMask && j<numSensors ; j++) {
+			if (mPendingMask & (1<<j)) {
+				mPendingMask &= ~(1<<j);
+				mPendingEvents[j].timestamp = timestamp;
+#if (SENSORS_ROTATION_PREDICTION_ENABLE == 1)
+				/* predicted rotation vectors are reported at the predicted time */
+				if (mPredictedMask & (1<<j)) {
+					mPredictedMask &= ~(1<<j);
+					mPendingEvents[j].timestamp += ROTATION_PREDICTION_NS;
+				}
+#endif
+				if (mEnabled & (1<<j)) {
+					*data++ = mPendingEvents[j];
+					count--;
+					numEventReceived++;
 				}
 			}
 		}
-		mInputReader.next();
 	}
-#if FETCH_FULL_EVENT_BEFORE_RETURN
-	/* if we didn't read a complete event, see if we can fill and
-	try again instead of returning with nothing and redoing poll. */
-	if (numEventReceived == 0 && mEnabled == 1) {
-		n = mInputReader.fill(data_fd);
-		if (n)
-			goto again;
-	}
-#endif
-
 
 	return numEventReceived;
 }
@@ -29,7 +29,8 @@
 
 #include "sensors.h"
 #include "SensorBase.h"
-#include "InputEventReader.h"
+#include "Decimator.h"
+#include "SensorHistory.h"
 
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
 #include "AccelSensor.h"
@@ -43,13 +44,15 @@
 
 extern "C"
 {
+#if (SENSORS_OPEN_FUSION_ENABLE == 1)
+	#include "OpenFusionAPI.h"
+#else
 	#include "iNemoEngineProAPI.h"
+#endif
 };
 
 /*****************************************************************************/
 
-struct input_event;
-
 class iNemoEngineSensor : public SensorBase
 {
 	enum {
@@ -67,16 +70,16 @@ class iNemoEngineSensor : public SensorBase
 	};
 
 	int initialized;
-	static int mEnabled;
+	int mEnabled;
 	uint32_t mPendingMask;
-	InputEventCircularReader mInputReader;
+	uint32_t mPredictedMask;	/* pending events extrapolated forward */
 	sensors_event_t mPendingEvents[numSensors];
 	bool mHasPendingEvent;
 	int setInitialState();
 
 private:
-	static int startup_samples;
-	static int samples_to_discard;
+	int startup_samples;
+	int samples_to_discard;
 	sensors_vec_t mSensorsBufferedVectors[3];
 	iNemoInitData init_data_api;
 	iNemoDebugInitData debug_init_data_api;
@@ -84,31 +87,39 @@ private:
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
 	char devices_sysfs_path_gyr[PATH_MAX];
 	int devices_sysfs_path_gyr_len;
-	static GyroSensor *gyr;
+	GyroSensor *gyr;
 #endif
 #if(SENSORS_ACCELEROMETER_ENABLE == 1)
 	char devices_sysfs_path_acc[PATH_MAX];
 	int devices_sysfs_path_acc_len;
-	static AccelSensor *acc;
+	AccelSensor *acc;
 #endif
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
 	char devices_sysfs_path_mag[PATH_MAX];
 	int devices_sysfs_path_mag_len;
-	static MagnSensor *mag;
+	MagnSensor *mag;
 #endif
-	static int status;
-	static int64_t gyroDelay_ms;
-	static int64_t DelayBuffer[numSensors];
-	static int DecimationBuffer[numSensors];
-	static int DecimationCount[numSensors];
+	int64_t gyroDelay_ms;
+	int64_t DelayBuffer[numSensors];
+	Decimator Decimation[numSensors];
+
+	SensorHistory *mClock;		/* history of the sensor driving the fusion */
+	uint32_t mCursor;		/* next sample of mClock to fuse */
 
 	int64_t timestamp;
+	int64_t mFusionTimestamp;	/* last sample fed to the fusion */
+
+	int64_t getFusionTimeElapsed(int64_t timestamp);
+
+	void beginDevicesConfig();
+	int commitDevicesConfig();
 
 public:
 	iNemoEngineSensor();
 	virtual ~iNemoEngineSensor();
 	virtual int readEvents(sensors_event_t* data, int count);
 	virtual bool hasPendingEvents() const;
+	virtual int getFd() const;
 	virtual int setDelay(int32_t handle, int64_t ns);
 	virtual int enable(int32_t handle, int enabled, int type);
 	virtual void updateDecimations(int64_t Delay_ms);
@@ -26,6 +26,10 @@
 #include <math.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <limits.h>
 #include <stdlib.h>
 
 #include <linux/input.h>
@@ -70,6 +74,12 @@
 #if ((SENSORS_HUMIDITY_ENABLE == 1) || (SENSORS_TEMP_RH_ENABLE == 1))
 #include "HumiditySensor.h"
 #endif
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+#include "SensorReaderThread.h"
+#endif
+#if (ANDROID_VERSION >= ANDROID_O)
+#include "DirectChannel.h"
+#endif
 
 
 /*****************************************************************************/
@@ -78,6 +88,30 @@
 
 #define LIGHT_SENSOR_POLLTIME		2000000000
 #define FREQUENCY_TO_USECONDS(x)		(1000000 / x)
+#define BATCH_FIFO_WATERMARK			((SENSORS_BATCH_FIFO_SIZE * 3) / 4)
+#define DRIVER_STAGE_SIZE			(32)
+#define FLUSH_QUEUE_SIZE			(64)
+#define DIRECT_CHANNEL_MAX			(8)
+#define SENSOR_DRIVERS_MAX			(32)	/* bits of the driver masks */
+
+#if (ANDROID_VERSION >= ANDROID_O)
+#define DIRECT_RATE_LEVEL(odr)			((odr) >= 440 ? SENSOR_DIRECT_RATE_VERY_FAST : \
+						((odr) >= 110 ? SENSOR_DIRECT_RATE_FAST : \
+						SENSOR_DIRECT_RATE_NORMAL))
+#define DIRECT_REPORT_FLAGS(odr)		(SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM | \
+						(DIRECT_RATE_LEVEL(odr) << SENSOR_FLAG_SHIFT_DIRECT_REPORT))
+#else
+#define DIRECT_REPORT_FLAGS(odr)		(0)
+#endif
+
+static inline int64_t getMonotonicTime()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
 
 /*****************************************************************************/
 
@@ -96,12 +130,12 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(ACCEL_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_ACCELEROMETER,
 		"",
 		FREQUENCY_TO_USECONDS(ACCEL_MIN_ODR),
-		SENSOR_FLAG_CONTINUOUS_MODE,
+		SENSOR_FLAG_CONTINUOUS_MODE | DIRECT_REPORT_FLAGS(ACCEL_MAX_ODR),
 #endif
 #endif
 		{ }
@@ -120,12 +154,12 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(MAGN_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_MAGNETIC_FIELD,
 		"",
 		FREQUENCY_TO_USECONDS(MAGN_MIN_ODR),
-		SENSOR_FLAG_CONTINUOUS_MODE,
+		SENSOR_FLAG_CONTINUOUS_MODE | DIRECT_REPORT_FLAGS(MAGN_MAX_ODR),
 #endif
 #endif
 		{ }
@@ -144,12 +178,12 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(GYRO_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GYROSCOPE,
 		"",
 		FREQUENCY_TO_USECONDS(GYRO_MIN_ODR),
-		SENSOR_FLAG_CONTINUOUS_MODE,
+		SENSOR_FLAG_CONTINUOUS_MODE | DIRECT_REPORT_FLAGS(GYRO_MAX_ODR),
 #endif
 #endif
 		{ }
@@ -168,7 +202,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(GYRO_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GYROSCOPE_UNCALIBRATED,
 		"",
@@ -224,7 +258,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(ORIENTATION_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_ORIENTATION,
 		"",
@@ -248,7 +282,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(FUSION_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GRAVITY,
 		"",
@@ -272,7 +306,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(FUSION_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_LINEAR_ACCELERATION,
 		"",
@@ -300,7 +334,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(FUSION_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_ROTATION_VECTOR,
 		"",
@@ -328,7 +362,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(FUSION_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GAME_ROTATION_VECTOR,
 		"",
@@ -352,7 +386,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(PRESS_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_PRESSURE,
 		"",
@@ -376,7 +410,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(TEMP_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_TEMPERATURE,
 		"",
@@ -400,7 +434,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(MAGN_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_MAGNETIC_FIELD_UNCALIBRATED,
 		"",
@@ -424,7 +458,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(MAGN_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GEOMAGNETIC_ROTATION_VECTOR,
 		"",
@@ -448,7 +482,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(VIRTUAL_GYRO_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_GYROSCOPE,
 		"",
@@ -622,7 +656,7 @@ static const struct sensor_t sSensorList[] = {
 		FREQUENCY_TO_USECONDS(HUMIDITY_MAX_ODR),
 #if (ANDROID_VERSION >= ANDROID_KK)
 		0,
-		0,
+		SENSORS_BATCH_FIFO_SIZE,
 #if (ANDROID_VERSION >= ANDROID_L)
 		SENSOR_STRING_TYPE_RELATIVE_HUMIDITY,
 		"",
@@ -635,6 +669,50 @@ static const struct sensor_t sSensorList[] = {
 #endif
 };
 
+/*
+ * sSensorList followed by the accelerometer and gyroscope of the extra
+ * IMU instances, built once with the handles allocated to them.
+ */
+static struct sensor_t sModuleSensorList[ARRAY_SIZE(sSensorList) +
+			(SENSORS_IMU_INSTANCES - 1) * SENSORS_IMU_HANDLES];
+static char sImuSensorNames[SENSORS_IMU_INSTANCES][SENSORS_IMU_HANDLES][64];
+static int sModuleSensorCount;
+static pthread_once_t sModuleSensorOnce = PTHREAD_ONCE_INIT;
+
+static void addImuSensor(const struct sensor_t* sensor, int instance,
+							int handle, char* name)
+{
+	struct sensor_t* copy = &sModuleSensorList[sModuleSensorCount++];
+
+	*copy = *sensor;
+	snprintf(name, sizeof(sImuSensorNames[0][0]), "%s %d",
+						sensor->name, instance + 1);
+	copy->name = name;
+	copy->handle = handle;
+}
+
+static void buildModuleSensorList()
+{
+	memcpy(sModuleSensorList, sSensorList, sizeof(sSensorList));
+	sModuleSensorCount = ARRAY_SIZE(sSensorList);
+
+	for (int instance = 1; instance < SENSORS_IMU_INSTANCES; instance++) {
+		for (size_t i = 0; i < ARRAY_SIZE(sSensorList); i++) {
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+			if (sSensorList[i].handle == SENSORS_ACCELEROMETER_HANDLE)
+				addImuSensor(&sSensorList[i], instance,
+					SENSORS_IMU_ACCELEROMETER_HANDLE(instance),
+					sImuSensorNames[instance][0]);
+#endif
+#if (SENSORS_GYROSCOPE_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_FUSION == 0)
+			if (sSensorList[i].handle == SENSORS_GYROSCOPE_HANDLE)
+				addImuSensor(&sSensorList[i], instance,
+					SENSORS_IMU_GYROSCOPE_HANDLE(instance),
+					sImuSensorNames[instance][1]);
+#endif
+		}
+	}
+}
 
 static int open_sensors(const struct hw_module_t* module, const char* id, struct hw_device_t** device);
 
@@ -647,8 +725,10 @@ static struct hw_module_methods_t sensors_module_methods = {
 int sensors__get_sensors_list(struct sensors_module_t __attribute__((unused))*module,
 						struct sensor_t const** list)
 {
-	*list = sSensorList;
-	return ARRAY_SIZE(sSensorList);
+	pthread_once(&sModuleSensorOnce, buildModuleSensorList);
+
+	*list = sModuleSensorList;
+	return sModuleSensorCount;
 };
 
 struct sensors_module_t HAL_MODULE_INFO_SYM = {
@@ -688,6 +768,12 @@ struct sensors_poll_context_t {
 										int64_t max_report_latency_ns);
 	int flush(int sensor_handle);
 #endif
+#if (ANDROID_VERSION >= ANDROID_O)
+	int registerDirectChannel(const struct sensors_direct_mem_t* mem,
+							int channel_handle);
+	int configDirectReport(int sensor_handle, int channel_handle,
+					const struct sensors_direct_cfg_t* config);
+#endif
 private:
 	enum {
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
@@ -727,18 +813,119 @@ private:
 		humidity,
 #endif
 		numSensorDrivers,
+		/* Drivers of the extra IMU instances follow the fixed ones */
+		maxSensorDrivers = numSensorDrivers +
+			(SENSORS_IMU_INSTANCES - 1) * SENSORS_IMU_HANDLES,
 		numFds,
 	};
 
-	struct pollfd mPollFds[numFds];
+	/**
+	 * Every driver fd is registered once into mEpollFd with its driver
+	 * index as epoll_data, so a wakeup only dispatches the ready drivers.
+	 * mPendingDrivers flags drivers that must be read even if their fd
+	 * is not ready (initial state after enable, or events left in the
+	 * driver buffer because the caller ran out of room).
+	 */
+	int mEpollFd;
+	volatile uint32_t mPendingDrivers;
 
 #if (ANDROID_VERSION >= ANDROID_JBMR2)
 	static const size_t flushFD = numFds - 1;
-	int mWriteFlushPipe;
-#endif
-	SensorBase* mSensors[numSensorDrivers];
+
+	/**
+	 * flush() queues the handle and signals mFlushFd. The poll loop then
+	 * drains the driver of each new request and reports the flush
+	 * complete once the events read before it have been delivered.
+	 * mFlushQueue[0..mFlushDrained) are the requests already drained,
+	 * mFlushingDrivers the drivers that may still hold older events.
+	 * The fusion and virtual gyroscope compute their events from the
+	 * samples of mDriverSources, which are drained before them. Reader
+	 * threads are asked once (mDrainRequested) to empty the driver fd.
+	 */
+	int mFlushFd;
+	pthread_mutex_t mFlushMutex;
+	int mFlushQueue[FLUSH_QUEUE_SIZE];
+	int mFlushCount;
+	int mFlushDrained;
+	uint32_t mFlushingDrivers;
+	uint32_t mDrainRequested;
+	uint32_t mDriverSources[maxSensorDrivers];
+
+	void drainFlushedDrivers();
+	bool driverDrained(int index);
+	bool flushDrained();
+	int reportFlushes(sensors_event_t* data, int count);
+
+	/**
+	 * Software batching: events of handles with a non-zero report
+	 * latency are held in mBatchFifo and released all together when the
+	 * oldest one reaches its latency, when the fifo fills up or on flush.
+	 */
+	volatile int64_t mBatchLatency[SENSORS_HANDLE_COUNT];
+	sensors_event_t mBatchFifo[SENSORS_BATCH_FIFO_SIZE];
+	int mBatchHead;
+	int mBatchCount;
+	int64_t mBatchDeadline;
+	volatile bool mBatchReleasing;
+
+	bool batchEvent(const sensors_event_t* event, int64_t now);
+	void popBatch(sensors_event_t* data);
+#endif
+#if (ANDROID_VERSION >= ANDROID_O)
+	/**
+	 * Direct report: mDirectPeriod is the fastest rate requested by the
+	 * channels for a handle (0 if none). The sensor stays enabled while
+	 * either the poll path (mPollEnabled) or a channel needs it.
+	 */
+	pthread_mutex_t mDirectMutex;
+	DirectChannel* mDirectChannels[DIRECT_CHANNEL_MAX];
+	volatile int64_t mDirectPeriod[SENSORS_HANDLE_COUNT];
+	int64_t mPollDelay[SENSORS_HANDLE_COUNT];
+	bool mPollEnabled[SENSORS_HANDLE_COUNT];
+
+	bool directReport(const sensors_event_t* event);
+	int updateDirectPeriod(int handle);
+	void stopDirectChannel(DirectChannel* channel);
+#endif
+	/**
+	 * mSensors[0..mNumDrivers) are the running drivers and mHandleDriver
+	 * maps every handle to its driver index (-EINVAL if none).
+	 */
+	SensorBase* mSensors[maxSensorDrivers];
+	int mNumDrivers;
+	int mHandleDriver[SENSORS_HANDLE_COUNT];
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	SensorReaderThread* mReaders[maxSensorDrivers];
+#endif
+
+	/**
+	 * Events are read from the ready drivers into per-driver staging
+	 * queues, then merged in timestamp order into the caller buffer.
+	 */
+	sensors_event_t mStaged[maxSensorDrivers][DRIVER_STAGE_SIZE];
+	int mStagedHead[maxSensorDrivers];
+	int mStagedCount[maxSensorDrivers];
+	uint32_t mStagedDrivers;
+
+	int addPollFd(int index, int fd);
+	int addDriver(int index);
+	void addImuDriver(SensorBase* sensor, int handle);
+	int readDriver(int index, sensors_event_t* data, int count);
+	int driverFd(int index) const;
+	void stageDriver(int index);
+	void drainDriver(int index);
+	int mergeEvents(sensors_event_t* data, int count, int64_t now);
+	int pollTimeout(int nbEvents) const;
 
 	int handleToDriver(int handle) const
+	{
+		if ((handle < 0) || (handle >= SENSORS_HANDLE_COUNT))
+			return -EINVAL;
+
+		return mHandleDriver[handle];
+	}
+
+	static int fixedHandleToDriver(int handle)
 	{
 		switch (handle) {
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
@@ -860,117 +1047,271 @@ private:
 /*****************************************************************************/
 
 sensors_poll_context_t::sensors_poll_context_t()
+	: mPendingDrivers(0),
+	mNumDrivers(numSensorDrivers),
+	mStagedDrivers(0)
 {
+	memset(mStagedHead, 0, sizeof(mStagedHead));
+	memset(mStagedCount, 0, sizeof(mStagedCount));
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+	memset((void *)mBatchLatency, 0, sizeof(mBatchLatency));
+	mBatchHead = 0;
+	mBatchCount = 0;
+	mBatchDeadline = INT64_MAX;
+	mBatchReleasing = false;
+#endif
+
+	mEpollFd = epoll_create(numFds);
+	if (mEpollFd < 0)
+		STLOGE("epoll_create() failed (%s)", strerror(errno));
+
 #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
-	mSensors[magn] = new MagnSensor();
-	mPollFds[magn].fd = mSensors[magn]->getFd();
-	mPollFds[magn].events = POLLIN;
-	mPollFds[magn].revents = 0;
+	mSensors[magn] = MagnSensor::getInstance();
+	addDriver(magn);
 #endif
 
 #if (SENSORS_GYROSCOPE_ENABLE == 1)
-	mSensors[gyro] = new GyroSensor();
-	mPollFds[gyro].fd = mSensors[gyro]->getFd();
-	mPollFds[gyro].events = POLLIN;
-	mPollFds[gyro].revents = 0;
+	mSensors[gyro] = GyroSensor::getInstance();
+	addDriver(gyro);
 #endif
 
 #if (SENSORS_VIRTUAL_GYROSCOPE_ENABLE == 1)
 	mSensors[virtual_gyro] = new VirtualGyroSensor();
-	mPollFds[virtual_gyro].fd = mSensors[virtual_gyro]->getFd();
-	mPollFds[virtual_gyro].events = POLLIN;
-	mPollFds[virtual_gyro].revents = 0;
+	addDriver(virtual_gyro);
 #endif
 
 #if (SENSORS_ACCELEROMETER_ENABLE == 1)
-	mSensors[accel] = new AccelSensor();
-	mPollFds[accel].fd = mSensors[accel]->getFd();
-	mPollFds[accel].events = POLLIN;
-	mPollFds[accel].revents = 0;
+	mSensors[accel] = AccelSensor::getInstance();
+	addDriver(accel);
 #endif
 
 #if (SENSOR_FUSION_ENABLE == 1)
 	mSensors[inemo] = new iNemoEngineSensor();
-	mPollFds[inemo].fd = mSensors[inemo]->getFd();
-	mPollFds[inemo].events = POLLIN;
-	mPollFds[inemo].revents = 0;
+	addDriver(inemo);
 #endif
 
 #if ((SENSORS_PRESSURE_ENABLE == 1) || (SENSORS_TEMP_PRESS_ENABLE == 1))
 	mSensors[press] = new PressSensor();
-	mPollFds[press].fd = mSensors[press]->getFd();
-	mPollFds[press].events = POLLIN;
-	mPollFds[press].revents = 0;
+	addDriver(press);
 #endif
 
 #if (SENSORS_TILT_ENABLE == 1)
 	mSensors[tilt] = new TiltSensor();
-	mPollFds[tilt].fd = mSensors[tilt]->getFd();
-	mPollFds[tilt].events = POLLIN;
-	mPollFds[tilt].revents = 0;
+	addDriver(tilt);
 #endif
 
 #if (SENSORS_STEP_COUNTER_ENABLE == 1)
 	mSensors[step_c] = new StepCounterSensor();
-	mPollFds[step_c].fd = mSensors[step_c]->getFd();
-	mPollFds[step_c].events = POLLIN;
-	mPollFds[step_c].revents = 0;
+	addDriver(step_c);
 #endif
 
 #if (SENSORS_STEP_DETECTOR_ENABLE == 1)
 	mSensors[step_d] = new StepDetectorSensor();
-	mPollFds[step_d].fd = mSensors[step_d]->getFd();
-	mPollFds[step_d].events = POLLIN;
-	mPollFds[step_d].revents = 0;
+	addDriver(step_d);
 #endif
 
 #if (SENSORS_SIGN_MOTION_ENABLE == 1)
 	mSensors[sign_m] = new SignMotionSensor();
-	mPollFds[sign_m].fd = mSensors[sign_m]->getFd();
-	mPollFds[sign_m].events = POLLIN;
-	mPollFds[sign_m].revents = 0;
+	addDriver(sign_m);
 #endif
 
 #if (SENSORS_TAP_ENABLE == 1)
 	mSensors[tap] = new TapSensor();
-	mPollFds[tap].fd = mSensors[tap]->getFd();
-	mPollFds[tap].events = POLLIN;
-	mPollFds[tap].revents = 0;
+	addDriver(tap);
 #endif
 
 #if ((SENSORS_HUMIDITY_ENABLE == 1) || (SENSORS_TEMP_RH_ENABLE == 1))
 	mSensors[humidity] = new HumiditySensor();
-	mPollFds[humidity].fd = mSensors[humidity]->getFd();
-	mPollFds[humidity].events = POLLIN;
-	mPollFds[humidity].revents = 0;
+	addDriver(humidity);
 #endif
 
-#if (ANDROID_VERSION >= ANDROID_JBMR2)
-	int FlushFds[2];
-	int err = pipe(FlushFds);
-	if (err < 0) {
-		ALOGE("Failed to create pipe for flush sensor.");
-	} else {
-		fcntl(FlushFds[0], F_SETFL, O_NONBLOCK);
-		fcntl(FlushFds[1], F_SETFL, O_NONBLOCK);
-		mWriteFlushPipe = FlushFds[1];
-		mPollFds[flushFD].fd = FlushFds[0];
-		mPollFds[flushFD].events = POLLIN;
-		mPollFds[flushFD].revents = 0;
+	for (int handle = 0; handle < SENSORS_HANDLE_COUNT; handle++)
+		mHandleDriver[handle] = fixedHandleToDriver(handle);
+
+	for (int instance = 1; instance < SENSORS_IMU_INSTANCES; instance++) {
+#if (SENSORS_ACCELEROMETER_ENABLE == 1)
+		addImuDriver(new AccelSensor(instance,
+				SENSORS_IMU_ACCELEROMETER_HANDLE(instance)),
+				SENSORS_IMU_ACCELEROMETER_HANDLE(instance));
+#endif
+#if (SENSORS_GYROSCOPE_ENABLE == 1) && (GYROSCOPE_GBIAS_ESTIMATION_FUSION == 0)
+		addImuDriver(new GyroSensor(instance,
+				SENSORS_IMU_GYROSCOPE_HANDLE(instance)),
+				SENSORS_IMU_GYROSCOPE_HANDLE(instance));
+#endif
 	}
+
+#if (ANDROID_VERSION >= ANDROID_O)
+	pthread_mutex_init(&mDirectMutex, NULL);
+	memset(mDirectChannels, 0, sizeof(mDirectChannels));
+	memset((void *)mDirectPeriod, 0, sizeof(mDirectPeriod));
+	memset(mPollDelay, 0, sizeof(mPollDelay));
+	memset(mPollEnabled, 0, sizeof(mPollEnabled));
+#endif
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+	pthread_mutex_init(&mFlushMutex, NULL);
+	mFlushCount = 0;
+	mFlushDrained = 0;
+	mFlushingDrivers = 0;
+	mDrainRequested = 0;
+
+	memset(mDriverSources, 0, sizeof(mDriverSources));
+#if (SENSOR_FUSION_ENABLE == 1)
+  #if (SENSORS_GYROSCOPE_ENABLE == 1)
+	mDriverSources[inemo] |= 1U << gyro;
+  #endif
+  #if (SENSORS_ACCELEROMETER_ENABLE == 1)
+	mDriverSources[inemo] |= 1U << accel;
+  #endif
+  #if (SENSORS_MAGNETIC_FIELD_ENABLE == 1)
+	mDriverSources[inemo] |= 1U << magn;
+  #endif
+#endif
+#if (SENSORS_VIRTUAL_GYROSCOPE_ENABLE == 1)
+	mDriverSources[virtual_gyro] = (1U << magn) | (1U << accel);
+#endif
+
+	mFlushFd = eventfd(0, EFD_NONBLOCK);
+	if (mFlushFd < 0)
+		ALOGE("Failed to create eventfd for flush sensor.");
+	else
+		addPollFd(flushFD, mFlushFd);
 #endif
 }
 
 sensors_poll_context_t::~sensors_poll_context_t()
 {
-	for (int i=0 ; i<numSensorDrivers ; i++) {
-		delete mSensors[i];
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	for (int i=0 ; i<mNumDrivers ; i++) {
+		delete mReaders[i];
+	}
+#endif
+
+#if (ANDROID_VERSION >= ANDROID_O)
+	for (int i=0 ; i<DIRECT_CHANNEL_MAX ; i++) {
+		delete mDirectChannels[i];
+	}
+	pthread_mutex_destroy(&mDirectMutex);
+#endif
+
+	for (int i=0 ; i<mNumDrivers ; i++) {
+		mSensors[i]->put();
 	}
 
 #if (ANDROID_VERSION >= ANDROID_JBMR2)
-	close(mPollFds[flushFD].fd);
-	close(mWriteFlushPipe);
+	if (mFlushFd >= 0)
+		close(mFlushFd);
+
+	pthread_mutex_destroy(&mFlushMutex);
 #endif
+	if (mEpollFd >= 0)
+		close(mEpollFd);
+}
+
+int sensors_poll_context_t::addPollFd(int index, int fd)
+{
+	struct epoll_event ev;
+
+	if ((mEpollFd < 0) || (fd < 0))
+		return -EINVAL;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = index;
+
+	if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		STLOGE("epoll_ctl() failed for driver %d (%s)", index, strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
+/*
+ * In threaded mode (every driver, or only the fusion one with
+ * FUSION_THREAD) the driver is drained by its reader thread and the
+ * poll loop waits on the reader eventfd instead of the driver fd.
+ */
+int sensors_poll_context_t::addDriver(int index)
+{
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	mReaders[index] = NULL;
+#if (SENSORS_FUSION_THREAD_ENABLE == 1) && (SENSOR_FUSION_ENABLE == 1)
+	if (index == inemo)
+		mReaders[index] = new SensorReaderThread(mSensors[index],
+						SENSORS_FUSION_THREAD_PRIORITY,
+						SENSORS_FUSION_THREAD_CPU);
+#endif
+#if (SENSORS_READER_THREADS_ENABLE == 1)
+	if (!mReaders[index])
+		mReaders[index] = new SensorReaderThread(mSensors[index]);
+#endif
+#endif
+
+	return addPollFd(index, driverFd(index));
+}
+
+/*
+ * Append the driver of an extra IMU instance and route its handle to it.
+ * A device that is not found is dropped and its handle fails to activate.
+ */
+void sensors_poll_context_t::addImuDriver(SensorBase* sensor, int handle)
+{
+	if ((sensor->getFd() < 0) || (mNumDrivers == SENSOR_DRIVERS_MAX)) {
+		STLOGE("No driver for IMU sensor handle %d", handle);
+		sensor->put();
+		return;
+	}
+
+	mSensors[mNumDrivers] = sensor;
+	mHandleDriver[handle] = mNumDrivers;
+	addDriver(mNumDrivers++);
+}
+
+int sensors_poll_context_t::driverFd(int index) const
+{
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	if (mReaders[index])
+		return mReaders[index]->getFd();
+#endif
+
+	return mSensors[index]->getFd();
+}
+
+int sensors_poll_context_t::readDriver(int index, sensors_event_t* data, int count)
+{
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	if (mReaders[index])
+		return mReaders[index]->readEvents(data, count);
+#endif
+
+	return mSensors[index]->readEvents(data, count);
+}
+
+int sensors_poll_context_t::pollTimeout(int nbEvents) const
+{
+	if (nbEvents || mPendingDrivers || mStagedDrivers)
+		return 0;
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+	if (mBatchReleasing || mFlushDrained)
+		return 0;
+
+	if (mBatchCount) {
+		int64_t left = mBatchDeadline - getMonotonicTime();
+
+		if (left <= 0)
+			return 0;
+
+		left = NSEC_TO_MSEC(left + MSEC_TO_NSEC(1LL) - 1);
+
+		return (left > INT_MAX) ? INT_MAX : (int)left;
+	}
+#endif
+
+	return -1;
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled)
@@ -979,7 +1320,36 @@ int sensors_poll_context_t::activate(int handle, int enabled)
 	if(index < 0)
 		return index;
 
+#if (ANDROID_VERSION >= ANDROID_O)
+	pthread_mutex_lock(&mDirectMutex);
+	mPollEnabled[handle] = enabled;
+	if (mDirectPeriod[handle]) {
+		/* Sensor already running for a direct channel */
+		int64_t ns = mDirectPeriod[handle];
+
+		if (enabled && mPollDelay[handle] && (mPollDelay[handle] < ns))
+			ns = mPollDelay[handle];
+
+		int err = mSensors[index]->setDelay(handle, ns);
+		pthread_mutex_unlock(&mDirectMutex);
+
+		return err;
+	}
+	pthread_mutex_unlock(&mDirectMutex);
+#endif
+
 	int err =  mSensors[index]->enable(handle, enabled, 0);
+	if (mSensors[index]->hasPendingEvents()) {
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+		/* The pending events are produced into the ring by the thread */
+		if (mReaders[index]) {
+			mReaders[index]->wake();
+			return err;
+		}
+#endif
+		__sync_fetch_and_or(&mPendingDrivers, 1U << index);
+	}
+
 	return err;
 }
 
@@ -989,55 +1359,379 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns)
 	if(index < 0)
 		return index;
 
+#if (ANDROID_VERSION >= ANDROID_O)
+	pthread_mutex_lock(&mDirectMutex);
+	mPollDelay[handle] = ns;
+	if (mDirectPeriod[handle] && (mDirectPeriod[handle] < ns))
+		ns = mDirectPeriod[handle];
+	int err = mSensors[index]->setDelay(handle, ns);
+	pthread_mutex_unlock(&mDirectMutex);
+
+	return err;
+#else
 	return mSensors[index]->setDelay(handle, ns);
+#endif
 }
 
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
+	struct epoll_event readyFds[numFds];
 	int nbEvents = 0;
 	int n = 0;
 
 	do {
+		uint32_t readyDrivers;
+		int64_t now = 0;
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+		bool flushReady = false;
+#endif
+
 		if (count) {
-			n = poll(mPollFds, numFds, nbEvents ? 0 : -1);
+			n = epoll_wait(mEpollFd, readyFds, numFds,
+				       pollTimeout(nbEvents));
 			if (n < 0) {
-				STLOGE("poll() failed (%s)", strerror(errno));
+				STLOGE("epoll_wait() failed (%s)", strerror(errno));
 				return -errno;
 			}
 		}
-		for (int i=0 ; count && i<numSensorDrivers ; i++) {
-			SensorBase* const sensor(mSensors[i]);
-			if((mPollFds[i].revents & POLLIN) || (sensor->hasPendingEvents()))
-			{
-				int nb = sensor->readEvents(data, count);
-				if (nb < count) {
-					mPollFds[i].revents = 0;
-				}
-				count -= nb;
-				nbEvents += nb;
-				data += nb;
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+		now = getMonotonicTime();
+#endif
+
+		readyDrivers = __sync_fetch_and_and(&mPendingDrivers, 0);
+		for (int i = 0; i < n; i++) {
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+			if (readyFds[i].data.u32 == flushFD) {
+				flushReady = true;
+				continue;
 			}
+#endif
+			readyDrivers |= 1U << readyFds[i].data.u32;
 		}
+
+		/*
+		 * Every ready driver is staged before anything is reported, so
+		 * a small caller buffer can not starve the last drivers.
+		 */
+		while (readyDrivers) {
+			int i = __builtin_ctz(readyDrivers);
+
+			readyDrivers &= ~(1U << i);
+			stageDriver(i);
+		}
+
 #if (ANDROID_VERSION >= ANDROID_JBMR2)
-		if(mPollFds[flushFD].revents & POLLIN && count) {
-			if (read(mPollFds[flushFD].fd, data, sizeof(struct sensors_event_t)) > 0) {
-				count--;
-				nbEvents++;
-				data++;
-			}
-			mPollFds[flushFD].revents = 0;
+		if (flushReady)
+			drainFlushedDrivers();
+
+		if (mBatchCount && (flushReady || (now >= mBatchDeadline)))
+			mBatchReleasing = true;
+#endif
+
+		if (count) {
+			int nb = mergeEvents(data, count, now);
+
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
+		}
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+		/* Flush complete is reported only once the queued events are out */
+		if (mFlushDrained && count && !mBatchCount && flushDrained() &&
+		    !mStagedDrivers) {
+			int nb = reportFlushes(data, count);
+
+			count -= nb;
+			nbEvents += nb;
+			data += nb;
 		}
 #endif
-	} while (n && count);
+	} while ((n || !nbEvents) && count);
 
 	return nbEvents;
 }
 
+/*
+ * Append the driver events to its staging queue. The driver stays pending
+ * if the queue filled up, as it may still hold some events.
+ */
+void sensors_poll_context_t::stageDriver(int index)
+{
+	sensors_event_t* queue = mStaged[index];
+	int room = DRIVER_STAGE_SIZE - mStagedCount[index];
+
+	if (room && mStagedHead[index]) {
+		memmove(queue, queue + mStagedHead[index],
+			mStagedCount[index] * sizeof(sensors_event_t));
+		mStagedHead[index] = 0;
+	}
+
+	if (room) {
+		int nb = readDriver(index, queue + mStagedCount[index], room);
+		if (nb < 0)
+			return;
+
+		mStagedCount[index] += nb;
+		if (nb)
+			mStagedDrivers |= 1U << index;
+
+		if (nb < room)
+			return;
+	}
+
+	__sync_fetch_and_or(&mPendingDrivers, 1U << index);
+}
+
+/*
+ * Stage every event the driver already holds, without blocking on an
+ * empty fd.
+ */
+void sensors_poll_context_t::drainDriver(int index)
+{
+	struct pollfd pfd;
+
+	pfd.fd = driverFd(index);
+	pfd.events = POLLIN;
+
+	while ((mStagedCount[index] < DRIVER_STAGE_SIZE) && (poll(&pfd, 1, 0) > 0))
+		stageDriver(index);
+}
+
+/*
+ * k-way merge of the staging queues, and of the batch fifo while it is
+ * released, in timestamp order. Events of batched handles are moved to
+ * the batch fifo instead of the caller buffer.
+ */
+int sensors_poll_context_t::mergeEvents(sensors_event_t* data, int count,
+					int64_t __attribute__((unused))now)
+{
+	int nb = 0;
+
+	while (nb < count) {
+		int64_t oldest = INT64_MAX;
+		int src = -1;
+
+		for (uint32_t m = mStagedDrivers; m; m &= m - 1) {
+			int i = __builtin_ctz(m);
+			int64_t t = mStaged[i][mStagedHead[i]].timestamp;
+
+			if ((src < 0) || (t < oldest)) {
+				oldest = t;
+				src = i;
+			}
+		}
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+		if (mBatchReleasing && mBatchCount &&
+		    ((src < 0) || (mBatchFifo[mBatchHead].timestamp <= oldest))) {
+			popBatch(&data[nb++]);
+			continue;
+		}
+#endif
+		if (src < 0)
+			break;
+
+		sensors_event_t* event = &mStaged[src][mStagedHead[src]++];
+		if (!--mStagedCount[src]) {
+			mStagedHead[src] = 0;
+			mStagedDrivers &= ~(1U << src);
+		}
+
+#if (ANDROID_VERSION >= ANDROID_O)
+		if (directReport(event))
+			continue;
+#endif
 #if (ANDROID_VERSION >= ANDROID_JBMR2)
+		/* No batching while a flush waits for the queues to empty */
+		if (!mFlushDrained && batchEvent(event, now))
+			continue;
+#endif
+		data[nb++] = *event;
+	}
+
+	return nb;
+}
+
+#if (ANDROID_VERSION >= ANDROID_JBMR2)
+/*
+ * Queue the event into the batch fifo if its handle has a report latency,
+ * return false if the event must be reported right away.
+ */
+bool sensors_poll_context_t::batchEvent(const sensors_event_t* event, int64_t now)
+{
+	int handle = event->sensor;
+	int64_t latency = 0;
+
+	if ((handle >= 0) && (handle < SENSORS_HANDLE_COUNT))
+		latency = mBatchLatency[handle];
+
+	if ((latency <= 0) || (event->type == SENSOR_TYPE_META_DATA))
+		return false;
+
+	if (mBatchCount == SENSORS_BATCH_FIFO_SIZE) {
+		/* Fifo overrun: drop the oldest event as a hw fifo does */
+		mBatchHead = (mBatchHead + 1) % SENSORS_BATCH_FIFO_SIZE;
+		mBatchCount--;
+		STLOGE("Batch fifo overrun, event dropped");
+	}
+
+	mBatchFifo[(mBatchHead + mBatchCount) % SENSORS_BATCH_FIFO_SIZE] = *event;
+	mBatchCount++;
+
+	if (now + latency < mBatchDeadline)
+		mBatchDeadline = now + latency;
+
+	if (mBatchCount >= BATCH_FIFO_WATERMARK)
+		mBatchReleasing = true;
+
+	return true;
+}
+
+void sensors_poll_context_t::drainFlushedDrivers()
+{
+	int handles[FLUSH_QUEUE_SIZE];
+	uint64_t value;
+	int first, last;
+
+	if (read(mFlushFd, &value, sizeof(value)) < 0)
+		return;
+
+	pthread_mutex_lock(&mFlushMutex);
+	first = mFlushDrained;
+	last = mFlushCount;
+	memcpy(handles, mFlushQueue, last * sizeof(int));
+	pthread_mutex_unlock(&mFlushMutex);
+
+	for (int i = first; i < last; i++) {
+		int index = handleToDriver(handles[i]);
+		uint32_t drivers = (1U << index) | mDriverSources[index];
+
+		/* Events queued since an earlier request need a new drain */
+		mFlushingDrivers |= drivers;
+		mDrainRequested &= ~drivers;
+	}
+
+	mFlushDrained = last;
+	flushDrained();
+}
+
+/*
+ * Stage the events the driver holds and return true if none is left. A
+ * reader thread first moves whatever is in the driver fd into its ring.
+ */
+bool sensors_poll_context_t::driverDrained(int index)
+{
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	if (mReaders[index] && !(mDrainRequested & (1U << index))) {
+		mReaders[index]->requestDrain();
+		mDrainRequested |= 1U << index;
+	}
+#endif
+
+	drainDriver(index);
+	if ((mStagedDrivers | mPendingDrivers) & (1U << index))
+		return false;
+
+#if (SENSORS_READER_THREADS_ENABLE == 1) || (SENSORS_FUSION_THREAD_ENABLE == 1)
+	if (mReaders[index] && !mReaders[index]->isDrained())
+		return false;
+#endif
+
+	return true;
+}
+
+/*
+ * The staging queue of a driver holds DRIVER_STAGE_SIZE events only, so a
+ * flushed driver is drained again each time the queue has been merged.
+ * Return true once none of them has events left, staged or unread.
+ */
+bool sensors_poll_context_t::flushDrained()
+{
+	uint32_t busy = 0;
+
+	/* Clocked drivers go last, once every sample of their sources is in */
+	for (int pass = 0; pass < 2; pass++) {
+		for (uint32_t m = mFlushingDrivers; m; m &= m - 1) {
+			int i = __builtin_ctz(m);
+
+			if ((pass == 0) == (mDriverSources[i] != 0))
+				continue;
+
+			if ((mDriverSources[i] & busy) || !driverDrained(i))
+				busy |= 1U << i;
+		}
+	}
+
+	if (!busy) {
+		mFlushingDrivers = 0;
+		mDrainRequested = 0;
+	}
+
+	return !busy;
+}
+
+int sensors_poll_context_t::reportFlushes(sensors_event_t* data, int count)
+{
+	int nb = (mFlushDrained < count) ? mFlushDrained : count;
+
+	pthread_mutex_lock(&mFlushMutex);
+	for (int i = 0; i < nb; i++) {
+		memset(&data[i], 0, sizeof(sensors_event_t));
+		data[i].version = META_DATA_VERSION;
+		data[i].type = SENSOR_TYPE_META_DATA;
+		data[i].meta_data.sensor = mFlushQueue[i];
+		data[i].meta_data.what = META_DATA_FLUSH_COMPLETE;
+	}
+
+	mFlushCount -= nb;
+	memmove(mFlushQueue, mFlushQueue + nb, mFlushCount * sizeof(int));
+	pthread_mutex_unlock(&mFlushMutex);
+
+	mFlushDrained -= nb;
+
+	return nb;
+}
+
+void sensors_poll_context_t::popBatch(sensors_event_t* data)
+{
+	*data = mBatchFifo[mBatchHead];
+	mBatchHead = (mBatchHead + 1) % SENSORS_BATCH_FIFO_SIZE;
+	mBatchCount--;
+
+	if (!mBatchCount) {
+		mBatchHead = 0;
+		mBatchDeadline = INT64_MAX;
+		mBatchReleasing = false;
+	}
+}
+
 int sensors_poll_context_t::batch(int sensor_handle, int __attribute__((unused))flags,
 						int64_t sampling_period_ns,
-				  int64_t __attribute__((unused))max_report_latency_ns)
+						int64_t max_report_latency_ns)
 {
+	int index = handleToDriver(sensor_handle);
+	if (index < 0)
+		return index;
+
+	if (max_report_latency_ns < 0)
+		max_report_latency_ns = 0;
+
+	/* Latency shortened or disabled: do not hold the queued events longer */
+	if (max_report_latency_ns < mBatchLatency[sensor_handle])
+		mBatchReleasing = true;
+
+	mBatchLatency[sensor_handle] = max_report_latency_ns;
+
+	/* Drivers size their input buffers for the longest latency they serve */
+	int64_t driverLatency = 0;
+	for (int handle = 0; handle < SENSORS_HANDLE_COUNT; handle++) {
+		if ((handleToDriver(handle) == index) &&
+				(mBatchLatency[handle] > driverLatency))
+			driverLatency = mBatchLatency[handle];
+	}
+	mSensors[index]->setLatency(driverLatency);
+
 	this->setDelay(sensor_handle, sampling_period_ns);
 
 	return 0;
@@ -1045,25 +1739,202 @@ int sensors_poll_context_t::batch(int sensor_handle, int __attribute__((unused))
 
 int sensors_poll_context_t::flush(int sensor_handle)
 {
-	sensors_event_t flush_event;
-	int err;
-
-	flush_event.timestamp = 0;
-	flush_event.meta_data.sensor = sensor_handle;
-	flush_event.meta_data.what = META_DATA_FLUSH_COMPLETE;
-	flush_event.type = SENSOR_TYPE_META_DATA;
-	flush_event.version = META_DATA_VERSION;
-	flush_event.sensor = 0;
-
-	err = write(mWriteFlushPipe, &flush_event, sizeof(flush_event));
-	if (err < 0) {
-		ALOGE("Failed to write flush data. %d", err);
+	uint64_t value = 1;
+
+	if (handleToDriver(sensor_handle) < 0)
+		return -EINVAL;
+
+	pthread_mutex_lock(&mFlushMutex);
+	if (mFlushCount == FLUSH_QUEUE_SIZE) {
+		pthread_mutex_unlock(&mFlushMutex);
+		ALOGE("Flush queue full, flush of handle %d dropped", sensor_handle);
+		return -EBUSY;
+	}
+	mFlushQueue[mFlushCount++] = sensor_handle;
+	pthread_mutex_unlock(&mFlushMutex);
+
+	if (write(mFlushFd, &value, sizeof(value)) < 0) {
+		ALOGE("Failed to signal flush. %d", -errno);
 		return -EINVAL;
 	}
 
 	return 0;
 }
 #endif
+#if (ANDROID_VERSION >= ANDROID_O)
+/*
+ * Write the event to the direct channels, return true if the handle is
+ * not enabled on the poll path and the event must not be reported there.
+ */
+bool sensors_poll_context_t::directReport(const sensors_event_t* event)
+{
+	int handle = event->sensor;
+	bool pollEnabled;
+
+	if ((handle < 0) || (handle >= SENSORS_HANDLE_COUNT) ||
+	    !mDirectPeriod[handle] || (event->type == SENSOR_TYPE_META_DATA))
+		return false;
+
+	pthread_mutex_lock(&mDirectMutex);
+	for (int i = 0; i < DIRECT_CHANNEL_MAX; i++) {
+		if (mDirectChannels[i])
+			mDirectChannels[i]->write(event);
+	}
+	pollEnabled = mPollEnabled[handle];
+	pthread_mutex_unlock(&mDirectMutex);
+
+	return !pollEnabled;
+}
+
+/*
+ * Recompute the fastest direct rate of the handle and reconfigure the
+ * sensor accordingly. Called with mDirectMutex held.
+ */
+int sensors_poll_context_t::updateDirectPeriod(int handle)
+{
+	int index = handleToDriver(handle);
+	int64_t period = 0;
+	int err = 0;
+
+	for (int i = 0; i < DIRECT_CHANNEL_MAX; i++) {
+		int64_t p;
+
+		if (!mDirectChannels[i])
+			continue;
+
+		p = mDirectChannels[i]->getPeriod(handle);
+		if (p && (!period || (p < period)))
+			period = p;
+	}
+
+	if (period) {
+		int64_t ns = period;
+
+		if (mPollEnabled[handle] && mPollDelay[handle] && (mPollDelay[handle] < ns))
+			ns = mPollDelay[handle];
+
+		if (!mDirectPeriod[handle] && !mPollEnabled[handle])
+			err = mSensors[index]->enable(handle, 1, 0);
+
+		if (!err)
+			err = mSensors[index]->setDelay(handle, ns);
+	} else if (mDirectPeriod[handle]) {
+		if (mPollEnabled[handle])
+			err = mSensors[index]->setDelay(handle, mPollDelay[handle]);
+		else
+			err = mSensors[index]->enable(handle, 0, 0);
+	}
+
+	mDirectPeriod[handle] = period;
+
+	return err;
+}
+
+/* Called with mDirectMutex held */
+void sensors_poll_context_t::stopDirectChannel(DirectChannel* channel)
+{
+	for (int handle = 0; handle < SENSORS_HANDLE_COUNT; handle++) {
+		if (channel->getPeriod(handle)) {
+			channel->configure(handle, SENSOR_DIRECT_RATE_STOP);
+			updateDirectPeriod(handle);
+		}
+	}
+}
+
+int sensors_poll_context_t::registerDirectChannel(const struct sensors_direct_mem_t* mem,
+								int channel_handle)
+{
+	DirectChannel* channel;
+	int i;
+
+	if (!mem) {
+		if ((channel_handle < 1) || (channel_handle > DIRECT_CHANNEL_MAX))
+			return -EINVAL;
+
+		pthread_mutex_lock(&mDirectMutex);
+		channel = mDirectChannels[channel_handle - 1];
+		if (channel)
+			stopDirectChannel(channel);
+		mDirectChannels[channel_handle - 1] = NULL;
+		pthread_mutex_unlock(&mDirectMutex);
+
+		delete channel;
+
+		return 0;
+	}
+
+	channel = new DirectChannel(mem);
+	if (!channel->isValid()) {
+		delete channel;
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&mDirectMutex);
+	for (i = 0; i < DIRECT_CHANNEL_MAX; i++) {
+		if (!mDirectChannels[i]) {
+			mDirectChannels[i] = channel;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&mDirectMutex);
+
+	if (i == DIRECT_CHANNEL_MAX) {
+		delete channel;
+		return -ENOMEM;
+	}
+
+	return i + 1;
+}
+
+int sensors_poll_context_t::configDirectReport(int sensor_handle, int channel_handle,
+					const struct sensors_direct_cfg_t* config)
+{
+	DirectChannel* channel;
+	bool supported = false;
+	int token;
+
+	if ((channel_handle < 1) || (channel_handle > DIRECT_CHANNEL_MAX))
+		return -EINVAL;
+
+	if (sensor_handle != -1) {
+		pthread_once(&sModuleSensorOnce, buildModuleSensorList);
+
+		for (int i = 0; i < sModuleSensorCount; i++) {
+			if ((sModuleSensorList[i].handle == sensor_handle) &&
+			    (sModuleSensorList[i].flags & SENSOR_FLAG_DIRECT_CHANNEL_ASHMEM))
+				supported = true;
+		}
+
+		if (!supported)
+			return -EINVAL;
+	}
+
+	pthread_mutex_lock(&mDirectMutex);
+	channel = mDirectChannels[channel_handle - 1];
+	if (!channel) {
+		pthread_mutex_unlock(&mDirectMutex);
+		return -EINVAL;
+	}
+
+	/* Handle -1 only supports stopping every report of the channel */
+	if (sensor_handle == -1) {
+		token = (config->rate_level == SENSOR_DIRECT_RATE_STOP) ? 0 : -EINVAL;
+		if (!token)
+			stopDirectChannel(channel);
+	} else {
+		token = channel->configure(sensor_handle, config->rate_level);
+		if (token >= 0) {
+			int err = updateDirectPeriod(sensor_handle);
+			if (err < 0)
+				token = err;
+		}
+	}
+	pthread_mutex_unlock(&mDirectMutex);
+
+	return token;
+}
+#endif
+
 /*****************************************************************************/
 
 static int poll__close(struct hw_device_t *dev)
@@ -1107,6 +1978,23 @@ static int poll__flush(struct sensors_poll_device_1* dev, int sensor_handle)
 	return ctx->flush(sensor_handle);
 }
 #endif
+
+#if (ANDROID_VERSION >= ANDROID_O)
+static int poll__register_direct_channel(struct sensors_poll_device_1* dev,
+			const struct sensors_direct_mem_t* mem, int channel_handle)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->registerDirectChannel(mem, channel_handle);
+}
+
+static int poll__config_direct_report(struct sensors_poll_device_1* dev,
+			int sensor_handle, int channel_handle,
+			const struct sensors_direct_cfg_t* config)
+{
+	sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+	return ctx->configDirectReport(sensor_handle, channel_handle, config);
+}
+#endif
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -1121,6 +2009,9 @@ static int open_sensors(const struct hw_module_t* module,
 
 	dev->device.common.tag		= HARDWARE_DEVICE_TAG;
 
+#if (ANDROID_VERSION >= ANDROID_O)
+	dev->device.common.version	= SENSORS_DEVICE_API_VERSION_1_4;
+#else
 #if (ANDROID_VERSION > ANDROID_KK)
 	dev->device.common.version	= SENSORS_DEVICE_API_VERSION_1_3;
 #else
@@ -1133,6 +2024,7 @@ static int open_sensors(const struct hw_module_t* module,
 	dev->device.common.version	= 0;
 #endif
 #endif
+#endif
 #endif
 	dev->device.common.module	= const_cast<hw_module_t*>(module);
 	dev->device.common.close	= poll__close;
@@ -1143,6 +2035,10 @@ static int open_sensors(const struct hw_module_t* module,
 	dev->device.batch			= poll__batch;
 	dev->device.flush			= poll__flush;
 #endif
+#if (ANDROID_VERSION >= ANDROID_O)
+	dev->device.register_direct_channel	= poll__register_direct_channel;
+	dev->device.config_direct_report	= poll__config_direct_report;
+#endif
 
 	*device = &dev->device.common;
 	status = 0;
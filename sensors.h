@@ -89,6 +89,19 @@ __BEGIN_DECLS
 #define SENSORS_TAP_HANDLE			ID_TAP
 #define SENSORS_HUMIDITY_HANDLE			ID_HUMIDITY
 
+#define SENSORS_MAX_HANDLE			(ID_HUMIDITY + 1)
+
+/* Handles of the extra IMU instances are allocated from SENSORS_MAX_HANDLE */
+#define SENSORS_IMU_HANDLES			(2)	/* accelerometer, gyroscope */
+#define SENSORS_HANDLE_COUNT			(SENSORS_MAX_HANDLE + \
+				(SENSORS_IMU_INSTANCES - 1) * SENSORS_IMU_HANDLES)
+#define SENSORS_IMU_ACCELEROMETER_HANDLE(i)	(SENSORS_MAX_HANDLE + \
+				((i) - 1) * SENSORS_IMU_HANDLES)
+#define SENSORS_IMU_GYROSCOPE_HANDLE(i)		(SENSORS_IMU_ACCELEROMETER_HANDLE(i) + 1)
+
+/* Software batching fifo, shared by all the continuous sensors (events) */
+#define SENSORS_BATCH_FIFO_SIZE			(1024)
+
 #define SENSOR_TYPE_TAP				(SENSOR_TYPE_DEVICE_PRIVATE_BASE + 2)
 #define SENSOR_TYPE_ACTIVITY			(SENSOR_TYPE_DEVICE_PRIVATE_BASE + 3)
 
@@ -0,0 +1,39 @@
+# Copyright (C) 2017 STMicroelectronics
+# Motion MEMS Product Div.
+# Copyright (C) 2008 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := sensors.stm_tests
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/.. \
+		    $(LOCAL_PATH)/../conf/
+
+LOCAL_CFLAGS := -DLOG_TAG=\"SensorsTest\" \
+		-DANDROID_VERSION=$(PLATFORM_SDK_VERSION)
+
+LOCAL_SRC_FILES := ../IIOBufferReader.cpp \
+		   ../SampleBlock.cpp \
+		   ../SensorHistory.cpp \
+		   IIOBufferReader_test.cpp \
+		   SensorHistory_test.cpp
+
+LOCAL_HEADER_LIBRARIES := libhardware_headers
+LOCAL_SHARED_LIBRARIES := liblog libcutils
+
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <gtest/gtest.h>
+
+#include "IIOBufferReader.h"
+
+/*****************************************************************************/
+
+/*
+ * Fake iio:deviceN sysfs directory in a temporary tree; the character
+ * device is replaced by a non-blocking pipe fed with packed scans.
+ */
+class IIOBufferReaderTest : public ::testing::Test {
+protected:
+	char mDir[PATH_MAX];
+	int mPipe[2];
+
+	virtual void SetUp() {
+		char path[PATH_MAX];
+
+		snprintf(mDir, sizeof(mDir), "/tmp/iio_test_XXXXXX");
+		ASSERT_TRUE(mkdtemp(mDir) != NULL);
+		strcat(mDir, "/");
+
+		snprintf(path, sizeof(path), "%sscan_elements", mDir);
+		ASSERT_EQ(0, mkdir(path, 0755));
+		snprintf(path, sizeof(path), "%sbuffer", mDir);
+		ASSERT_EQ(0, mkdir(path, 0755));
+
+		writeFile(IIO_BUFFER_ENABLE_FILE_NAME, "1");
+		writeFile(IIO_BUFFER_LENGTH_FILE_NAME, "2");
+
+		ASSERT_EQ(0, pipe(mPipe));
+		fcntl(mPipe[0], F_SETFL, O_NONBLOCK);
+	}
+
+	virtual void TearDown() {
+		close(mPipe[0]);
+		close(mPipe[1]);
+		nftw(mDir, removeEntry, 8, FTW_DEPTH | FTW_PHYS);
+	}
+
+	static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+		return remove(path);
+	}
+
+	void writeFile(const char* name, const char* value) {
+		char path[PATH_MAX];
+		FILE* f;
+
+		snprintf(path, sizeof(path), "%s%s", mDir, name);
+		f = fopen(path, "w");
+		ASSERT_TRUE(f != NULL);
+		fputs(value, f);
+		fclose(f);
+	}
+
+	void readFile(const char* name, char* buf, int len) {
+		char path[PATH_MAX];
+		FILE* f;
+
+		snprintf(path, sizeof(path), "%s%s", mDir, name);
+		f = fopen(path, "r");
+		ASSERT_TRUE(f != NULL);
+		ASSERT_TRUE(fgets(buf, len, f) != NULL);
+		fclose(f);
+	}
+
+	void addChannel(const char* name, int index, const char* type) {
+		char file[NAME_MAX], buf[16];
+
+		snprintf(file, sizeof(file), "scan_elements/%s_en", name);
+		writeFile(file, "0");
+		snprintf(file, sizeof(file), "scan_elements/%s_index", name);
+		snprintf(buf, sizeof(buf), "%d\n", index);
+		writeFile(file, buf);
+		snprintf(file, sizeof(file), "scan_elements/%s_type", name);
+		writeFile(file, type);
+	}
+
+	void feed(const void* data, size_t len) {
+		ASSERT_EQ((ssize_t)len, write(mPipe[1], data, len));
+	}
+};
+
+struct le16_scan {
+	int16_t x, y, z;
+	int16_t pad;
+	int64_t timestamp;
+} __attribute__((packed));
+
+TEST_F(IIOBufferReaderTest, DecodesLittleEndianScans) {
+	IIOBufferReader reader("accel");
+	struct le16_scan scans[2] = {
+		{ 1, -2, 16384, 0, 1000000000LL },
+		{ -32768, 32767, 0, 0, 1002500000LL },
+	};
+	SampleBlock block;
+	char buf[16];
+
+	addChannel("in_accel_x", 0, "le:s16/16>>0\n");
+	addChannel("in_accel_y", 1, "le:s16/16>>0\n");
+	addChannel("in_accel_z", 2, "le:s16/16>>0\n");
+	addChannel("in_timestamp", 3, "le:s64/64>>0\n");
+	addChannel("in_temp", 4, "le:s16/16>>0\n");
+	writeFile("in_accel_scale", "0.000598\n");
+
+	ASSERT_EQ(0, reader.setup(mDir));
+	EXPECT_FLOAT_EQ(0.000598f, reader.getScale());
+
+	readFile("scan_elements/in_accel_x_en", buf, sizeof(buf));
+	EXPECT_STREQ("1", buf);
+	readFile("scan_elements/in_timestamp_en", buf, sizeof(buf));
+	EXPECT_STREQ("1", buf);
+	readFile("scan_elements/in_temp_en", buf, sizeof(buf));
+	EXPECT_STREQ("0", buf);
+	readFile(IIO_BUFFER_ENABLE_FILE_NAME, buf, sizeof(buf));
+	EXPECT_STREQ("0", buf);
+
+	feed(scans, sizeof(scans));
+	ASSERT_EQ(2, reader.fill(mPipe[0], &block, SAMPLE_BLOCK_SIZE));
+	ASSERT_EQ(2, block.count);
+
+	EXPECT_FLOAT_EQ(1.0f, block.x[0]);
+	EXPECT_FLOAT_EQ(-2.0f, block.y[0]);
+	EXPECT_FLOAT_EQ(16384.0f, block.z[0]);
+	EXPECT_EQ(1000000000LL, block.timestamp[0]);
+
+	EXPECT_FLOAT_EQ(-32768.0f, block.x[1]);
+	EXPECT_FLOAT_EQ(32767.0f, block.y[1]);
+	EXPECT_FLOAT_EQ(0.0f, block.z[1]);
+	EXPECT_EQ(1002500000LL, block.timestamp[1]);
+}
+
+TEST_F(IIOBufferReaderTest, DecodesBigEndianShiftedScansByIndex) {
+	IIOBufferReader reader("anglvel");
+	SampleBlock block;
+	/* z, x, y as 12 bits left-justified in be16, then the timestamp */
+	const uint8_t scan[16] = {
+		0xff, 0xf0,	/* z = -1 */
+		0x00, 0x10,	/* x = 1 */
+		0x80, 0x00,	/* y = -2048 */
+		0x00, 0x00,
+		0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+
+	addChannel("in_anglvel_z", 0, "be:s12/16>>4\n");
+	addChannel("in_anglvel_x", 1, "be:s12/16>>4\n");
+	addChannel("in_anglvel_y", 2, "be:s12/16>>4\n");
+	addChannel("in_timestamp", 3, "le:s64/64>>0\n");
+
+	ASSERT_EQ(0, reader.setup(mDir));
+
+	feed(scan, sizeof(scan));
+	ASSERT_EQ(1, reader.fill(mPipe[0], &block, SAMPLE_BLOCK_SIZE));
+
+	EXPECT_FLOAT_EQ(1.0f, block.x[0]);
+	EXPECT_FLOAT_EQ(-2048.0f, block.y[0]);
+	EXPECT_FLOAT_EQ(-1.0f, block.z[0]);
+	EXPECT_EQ(1LL, block.timestamp[0]);
+}
+
+TEST_F(IIOBufferReaderTest, FillHonorsMaxFramesAndEmptyBuffer) {
+	IIOBufferReader reader("accel");
+	struct le16_scan scans[3] = {
+		{ 1, 1, 1, 0, 10 },
+		{ 2, 2, 2, 0, 20 },
+		{ 3, 3, 3, 0, 30 },
+	};
+	SampleBlock block;
+
+	addChannel("in_accel_x", 0, "le:s16/16>>0\n");
+	addChannel("in_accel_y", 1, "le:s16/16>>0\n");
+	addChannel("in_accel_z", 2, "le:s16/16>>0\n");
+	addChannel("in_timestamp", 3, "le:s64/64>>0\n");
+
+	EXPECT_EQ(-EINVAL, reader.fill(mPipe[0], &block, SAMPLE_BLOCK_SIZE));
+	ASSERT_EQ(0, reader.setup(mDir));
+
+	EXPECT_EQ(0, reader.fill(mPipe[0], &block, SAMPLE_BLOCK_SIZE));
+
+	feed(scans, sizeof(scans));
+	ASSERT_EQ(2, reader.fill(mPipe[0], &block, 2));
+	ASSERT_EQ(1, reader.fill(mPipe[0], &block, SAMPLE_BLOCK_SIZE));
+	ASSERT_EQ(3, block.count);
+	EXPECT_FLOAT_EQ(3.0f, block.x[2]);
+	EXPECT_EQ(30LL, block.timestamp[2]);
+}
+
+TEST_F(IIOBufferReaderTest, SetupFailsOnMissingChannel) {
+	IIOBufferReader reader("magn");
+
+	addChannel("in_magn_x", 0, "le:s16/16>>0\n");
+	addChannel("in_magn_y", 1, "le:s16/16>>0\n");
+	addChannel("in_timestamp", 3, "le:s64/64>>0\n");
+
+	EXPECT_EQ(-1, reader.setup(mDir));
+}
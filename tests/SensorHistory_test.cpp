@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2017 STMicroelectronics
+ * Motion MEMS Product Div.
+ * Copyright (C) 2008 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <gtest/gtest.h>
+
+#include "SensorHistory.h"
+
+/*****************************************************************************/
+
+static void writeSamples(SensorHistory *history, int first, int count)
+{
+	sensors_vec_t value;
+	int i;
+
+	memset(&value, 0, sizeof(value));
+	for (i = first; i < first + count; i++) {
+		value.x = (float)i;
+		history->write(&value, (int64_t)i * 1000);
+	}
+}
+
+TEST(SensorHistoryTest, ReadNextWalksPublishedSamples) {
+	SensorHistory history;
+	sensors_vec_t value;
+	int64_t timestamp;
+	uint32_t cursor = history.getHead();
+	int i;
+
+	EXPECT_FALSE(history.readNext(&cursor, &value, &timestamp));
+
+	writeSamples(&history, 0, 10);
+	for (i = 0; i < 10; i++) {
+		ASSERT_TRUE(history.readNext(&cursor, &value, &timestamp));
+		EXPECT_FLOAT_EQ((float)i, value.x);
+		EXPECT_EQ((int64_t)i * 1000, timestamp);
+	}
+
+	EXPECT_FALSE(history.readNext(&cursor, &value, &timestamp));
+	EXPECT_EQ(history.getHead(), cursor);
+}
+
+TEST(SensorHistoryTest, LappedReaderResumesFromOldestSample) {
+	SensorHistory history;
+	sensors_vec_t value;
+	int64_t timestamp;
+	uint32_t cursor = history.getHead();
+
+	writeSamples(&history, 0, SENSOR_HISTORY_SIZE + 10);
+
+	ASSERT_TRUE(history.readNext(&cursor, &value, &timestamp));
+	EXPECT_FLOAT_EQ(10.0f, value.x);
+	EXPECT_EQ(11U, cursor);
+}
+
+TEST(SensorHistoryTest, ReadAtInterpolatesBetweenSamples) {
+	SensorHistory history;
+	sensors_vec_t value;
+
+	writeSamples(&history, 0, 10);
+
+	history.readAt(&value, 2500);
+	EXPECT_FLOAT_EQ(2.5f, value.x);
+
+	history.readAt(&value, 7250);
+	EXPECT_FLOAT_EQ(7.25f, value.x);
+}
+
+TEST(SensorHistoryTest, ReadAtReturnsExactSample) {
+	SensorHistory history;
+	sensors_vec_t value;
+
+	writeSamples(&history, 0, 10);
+
+	history.readAt(&value, 4000);
+	EXPECT_FLOAT_EQ(4.0f, value.x);
+
+	history.readAt(&value, 0);
+	EXPECT_FLOAT_EQ(0.0f, value.x);
+
+	history.readAt(&value, 9000);
+	EXPECT_FLOAT_EQ(9.0f, value.x);
+}
+
+TEST(SensorHistoryTest, ReadAtClampsOutOfHistory) {
+	SensorHistory history;
+	sensors_vec_t value;
+
+	writeSamples(&history, 1, 10);
+
+	history.readAt(&value, -500);
+	EXPECT_FLOAT_EQ(1.0f, value.x);
+
+	history.readAt(&value, 500);
+	EXPECT_FLOAT_EQ(1.0f, value.x);
+
+	history.readAt(&value, 20000);
+	EXPECT_FLOAT_EQ(10.0f, value.x);
+}
+
+TEST(SensorHistoryTest, ReadAtWrappedRing) {
+	SensorHistory history;
+	sensors_vec_t value;
+
+	writeSamples(&history, 0, SENSOR_HISTORY_SIZE + 10);
+
+	/* samples 0..9 have been overwritten */
+	history.readAt(&value, 5000);
+	EXPECT_FLOAT_EQ(10.0f, value.x);
+
+	history.readAt(&value, 100500);
+	EXPECT_FLOAT_EQ(100.5f, value.x);
+
+	history.readAt(&value, (SENSOR_HISTORY_SIZE + 9) * 1000 - 250);
+	EXPECT_FLOAT_EQ((float)(SENSOR_HISTORY_SIZE + 9) - 0.25f, value.x);
+
+	history.readAt(&value, (SENSOR_HISTORY_SIZE + 20) * 1000);
+	EXPECT_FLOAT_EQ((float)(SENSOR_HISTORY_SIZE + 9), value.x);
+}
+
+TEST(SensorHistoryTest, ReadAtEmptyHistory) {
+	SensorHistory history;
+	sensors_vec_t value;
+
+	memset(&value, 0xff, sizeof(value));
+	history.readAt(&value, 1000);
+	EXPECT_FLOAT_EQ(0.0f, value.x);
+	EXPECT_FLOAT_EQ(0.0f, value.y);
+	EXPECT_FLOAT_EQ(0.0f, value.z);
+}
+
+TEST(SensorHistoryTest, NotifySignalsListenersOncePerBlock) {
+	SensorHistory history;
+	int fd = eventfd(0, EFD_NONBLOCK);
+	uint64_t signaled;
+
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(0, history.addListener(fd));
+
+	history.notify();
+	EXPECT_GT(0, read(fd, &signaled, sizeof(signaled)));
+
+	writeSamples(&history, 0, 4);
+	history.notify();
+	history.notify();
+	ASSERT_EQ((ssize_t)sizeof(signaled), read(fd, &signaled, sizeof(signaled)));
+	EXPECT_EQ(1U, signaled);
+
+	history.removeListener(fd);
+	writeSamples(&history, 4, 1);
+	history.notify();
+	EXPECT_GT(0, read(fd, &signaled, sizeof(signaled)));
+
+	close(fd);
+}